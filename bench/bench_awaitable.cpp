@@ -0,0 +1,112 @@
+// Time per co_await of an operation selected at runtime, held by a polymorphic_awaitable and by a unique_ptr to an awaiter
+// interface which allocates for each await. The operations alternate between completing immediately and suspending with symmetric
+// transfer back to the awaiting coroutine. The await count can be given on the command line, the default is 10M.
+
+#include "polymorphic_awaitable.h"
+
+#include <chrono>
+#include <coroutine>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    ~Task() { handle.destroy(); }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct Cached {
+    bool await_ready() { return true; }
+    void await_suspend(std::coroutine_handle<>) {}
+    long await_resume() { return value; }
+    long value;
+};
+
+struct Computed {
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) { result = value * 3; return h; }
+    long await_resume() { return result; }
+    long value;
+    long result = 0;
+};
+
+// The unique_ptr baseline.
+struct Operation {
+    virtual ~Operation() {}
+    virtual bool await_ready() = 0;
+    virtual std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) = 0;
+    virtual long await_resume() = 0;
+};
+
+template<typename A> struct OperationFor : public Operation {
+    OperationFor(long v) : awaiter{ v } {}
+    bool await_ready() override { return awaiter.await_ready(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) override {
+        if constexpr (std::is_void_v<decltype(awaiter.await_suspend(h))>) {
+            awaiter.await_suspend(h);
+            return std::noop_coroutine();
+        }
+        else
+            return awaiter.await_suspend(h);
+    }
+    long await_resume() override { return awaiter.await_resume(); }
+    A awaiter;
+};
+
+struct BoxedOperation {
+    bool await_ready() { return op->await_ready(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) { return op->await_suspend(h); }
+    long await_resume() { return op->await_resume(); }
+    std::unique_ptr<Operation> op;
+};
+
+static BoxedOperation boxed(long i)
+{
+    if (i % 2 == 0)
+        return { std::make_unique<OperationFor<Cached>>(i) };
+    return { std::make_unique<OperationFor<Computed>>(i) };
+}
+
+static stdx::polymorphic_awaitable<long> inline_awaitable(long i)
+{
+    if (i % 2 == 0)
+        return Cached{ i };
+    return Computed{ i };
+}
+
+template<typename F> static Task run(F make, long count, long& sum)
+{
+    for (long i = 0; i < count; i++)
+        sum += co_await make(i);
+}
+
+template<typename F> static void measure(const char* name, F make, long count)
+{
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        Task task = run(make, count, sum);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << double(ns) / count << " ns per await (" << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    long count = argc > 1 ? std::strtol(argv[1], nullptr, 10) : 10000000;
+
+    for (int round = 0; round < 2; round++) {
+        measure("unique_ptr", boxed, count);
+        measure("polymorphic_awaitable", inline_awaitable, count);
+    }
+}
@@ -0,0 +1,47 @@
+// Time spent in reset() on the calling thread for objects with expensive destructors, with and without the deferred_destroy option.
+// Each object owns 1000 strings on the heap. The object count can be given on the command line, the default is 1000
+// which fits the ring of retired objects.
+
+#include "polymorphic_value_reclaimer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Cache {
+    virtual ~Cache() {}
+};
+
+struct LruCache : public Cache {
+    LruCache() {
+        for (int i = 0; i < 1000; i++)
+            entries.push_back(std::string(32, char('a' + i % 26)));
+    }
+    std::vector<std::string> entries;
+};
+
+template<typename Poly> static void measure(const char* name, size_t count)
+{
+    std::vector<Poly> caches(count);
+    for (Poly& c : caches)
+        c.template emplace<LruCache>();
+
+    auto start = std::chrono::steady_clock::now();
+    for (Poly& c : caches)
+        c.reset();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    stdx::polymorphic_value_reclaimer::instance().flush();
+    std::cout << name << ": " << double(us) / count << " us per reset" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000;
+
+    for (int round = 0; round < 2; round++) {
+        measure<stdx::polymorphic_value<Cache, { .size = 16 }>>("direct", count);
+        measure<stdx::polymorphic_value<Cache, { .size = 16, .deferred_destroy = true }>>("deferred", count);
+    }
+}
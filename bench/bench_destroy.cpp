@@ -0,0 +1,79 @@
+// Destruction of a vector of polymorphic_values of trivially destructible classes in random order by the vector's clear, by clear
+// and by clear with the heap blocks freed on a background thread. With a 16 byte SBO buffer a quarter of the objects are heap
+// allocated, with an 80 byte buffer all are inline. The element count can be given on the command line, the default is 10M.
+
+#include "polymorphic_value_batch_destroy.h"
+#include "polymorphic_value_reclaimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Particle {
+    float x = 0, y = 0;
+};
+
+template<int N> struct Spark : public Particle {
+    Spark(float b) : brightness(b) {}
+    float brightness;
+};
+
+struct Trail : public Particle {
+    Trail(float v) { points[0] = v; }
+    float points[16] = {};          // Does not fit the 16 byte SBO buffer.
+};
+
+using HeapPoly = stdx::polymorphic_value<Particle, { .size = 16 }>;
+using InlinePoly = stdx::polymorphic_value<Particle, { .size = 80 }>;
+
+template<typename Poly> static std::vector<Poly> make_particles(size_t count)
+{
+    std::vector<Poly> particles;
+    particles.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        switch (i % 8) {
+        case 0: case 1: particles.emplace_back(std::in_place_type<Trail>, float(i)); break;
+        case 2: particles.emplace_back(std::in_place_type<Spark<2>>, float(i)); break;
+        case 3: particles.emplace_back(std::in_place_type<Spark<3>>, float(i)); break;
+        case 4: particles.emplace_back(std::in_place_type<Spark<4>>, float(i)); break;
+        case 5: particles.emplace_back(std::in_place_type<Spark<5>>, float(i)); break;
+        case 6: particles.emplace_back(std::in_place_type<Spark<6>>, float(i)); break;
+        default: particles.emplace_back(std::in_place_type<Spark<7>>, float(i)); break;
+        }
+    }
+    std::shuffle(particles.begin(), particles.end(), std::mt19937_64(42));
+    return particles;
+}
+
+template<typename Poly, typename F> static void measure(const char* name, size_t count, F f)
+{
+    std::vector<Poly> particles = make_particles<Poly>(count);
+    auto start = std::chrono::steady_clock::now();
+    f(particles);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ms << " ms" << std::endl;
+}
+
+template<typename Poly> static void run(const std::string& name, size_t count)
+{
+    measure<Poly>((name + ", vector::clear").c_str(), count, [](std::vector<Poly>& particles) { particles.clear(); });
+    measure<Poly>((name + ", clear").c_str(), count, [](std::vector<Poly>& particles) { stdx::clear(particles); });
+    measure<Poly>((name + ", clear, free in background").c_str(), count, [](std::vector<Poly>& particles) {
+        stdx::clear(particles, stdx::polymorphic_value_reclaimer::instance());
+    });
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+    for (int round = 0; round < 2; round++) {
+        run<HeapPoly>("16 byte buffer", count);
+        run<InlinePoly>("80 byte buffer", count);
+    }
+}
@@ -0,0 +1,96 @@
+// Time per event of a hold model simulation, where each dispatched event schedules a new one at a random later time, with a
+// polymorphic_event_queue and with a std::priority_queue of (time, polymorphic_value) pairs. The number of pending events can be
+// given on the command line, the default is 100000. 10M events are dispatched. The checksums differ a little as events with equal
+// times are dispatched in different orders.
+
+#include "polymorphic_event_queue.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+struct Event {
+    virtual ~Event() {}
+    virtual uint64_t delay(uint64_t r) const { return r % 1000; }
+};
+
+struct Arrival : public Event {
+    Arrival(int n) : n(n) {}
+    uint64_t delay(uint64_t r) const override { return r % 1000 + n % 3; }
+    int n;
+    double state[6] = {};
+};
+
+struct Departure : public Event {
+    Departure(int n) : n(n) {}
+    uint64_t delay(uint64_t r) const override { return r % 500; }
+    int n;
+    double state[4] = {};
+};
+
+using Poly = stdx::polymorphic_value<Event>;
+
+template<typename Queue, typename Schedule, typename Dispatch>
+static void measure(const char* name, size_t pending, size_t events, Schedule schedule, Dispatch dispatch)
+{
+    Queue queue;
+    std::mt19937_64 random(1);
+    for (size_t i = 0; i < pending; i++)
+        schedule(queue, random() % 1000, int(i));
+
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < events; i++)
+        checksum += dispatch(queue, random(), int(i));
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << double(ns) / events << " ns per event (" << checksum << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t pending = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    const size_t events = 10'000'000;
+
+    using Entry = std::pair<uint64_t, Poly>;
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const { return a.first > b.first; }
+    };
+    using PriorityQueue = std::priority_queue<Entry, std::vector<Entry>, Later>;
+    using EventQueue = stdx::polymorphic_event_queue<Event>;
+
+    for (int round = 0; round < 2; round++) {
+        measure<PriorityQueue>("priority_queue", pending, events,
+            [](PriorityQueue& q, uint64_t time, int n) {
+                q.emplace(time, n % 2 ? Poly(std::in_place_type<Arrival>, n) : Poly(std::in_place_type<Departure>, n));
+            },
+            [](PriorityQueue& q, uint64_t r, int n) {
+                uint64_t now = q.top().first;
+                uint64_t time = now + 1 + q.top().second->delay(r);
+                q.pop();
+                q.emplace(time, n % 2 ? Poly(std::in_place_type<Arrival>, n) : Poly(std::in_place_type<Departure>, n));
+                return now;
+            });
+        measure<EventQueue>("polymorphic_event_queue", pending, events,
+            [](EventQueue& q, uint64_t time, int n) {
+                if (n % 2)
+                    q.schedule<Arrival>(time, n);
+                else
+                    q.schedule<Departure>(time, n);
+            },
+            [](EventQueue& q, uint64_t r, int n) {
+                q.dispatch([&](Event& e) {
+                    uint64_t time = q.now() + 1 + e.delay(r);
+                    if (n % 2)
+                        q.schedule<Arrival>(time, n);
+                    else
+                        q.schedule<Departure>(time, n);
+                });
+                return q.now();
+            });
+    }
+}
@@ -0,0 +1,125 @@
+// Data TLB misses and time of scans over heap allocated objects in random order, with the objects allocated by make_unique and by
+// the huge_pages option. Other allocations are interleaved with the objects so that they are spread over more pages, as in a long
+// running program. TLB misses are counted with perf_event_open where available, otherwise only the time is reported. The object
+// count can be given on the command line, the default is 1M.
+
+#include "polymorphic_value.h"
+#include "polymorphic_value_huge_page_heap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct Particle {
+    virtual ~Particle() {}
+    virtual double energy() const = 0;
+};
+
+struct Body : public Particle {
+    Body(double m) : mass(m) {}
+    double energy() const override { return mass * (vx * vx + vy * vy + vz * vz) / 2; }
+    double mass;
+    double vx = 1, vy = 2, vz = 3;
+    double history[16] = {};
+};
+
+// Counts data TLB read misses of this thread in user mode.
+class tlb_miss_counter {
+public:
+    tlb_miss_counter() {
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+    ~tlb_miss_counter() {
+#if defined(__linux__)
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    bool available() const { return m_fd >= 0; }
+
+    void start() {
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    long long stop() {
+        long long count = 0;
+#if defined(__linux__)
+        if (m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+template<typename Poly> static void measure(const char* name, size_t count, const std::vector<size_t>& order, tlb_miss_counter& counter)
+{
+    std::vector<Poly> bodies(count);
+    std::vector<std::unique_ptr<char[]>> others;
+    for (size_t i = 0; i < count; i++) {
+        bodies[i].template emplace<Body>(double(i % 7));
+        others.push_back(std::make_unique<char[]>(200));
+    }
+
+    double sum = 0;
+    counter.start();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i : order)
+        sum += bodies[i]->energy();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    long long misses = counter.stop();
+
+    std::cout << name << ": " << ms << " ms";
+    if (counter.available())
+        std::cout << ", " << double(misses) / count << " dTLB misses per object";
+    std::cout << " (" << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(1));
+
+    tlb_miss_counter counter;
+    if (!counter.available())
+        std::cout << "perf_event_open is not available, only times are reported" << std::endl;
+
+    for (int round = 0; round < 2; round++) {
+        measure<stdx::polymorphic_value<Particle, { .size = 16 }>>("make_unique", count, order, counter);
+        measure<stdx::polymorphic_value<Particle, { .size = 16, .huge_pages = true }>>("huge_pages", count, order, counter);
+    }
+}
@@ -0,0 +1,92 @@
+// Loading 1M records of a snapshot eagerly into polymorphic_values and lazily into lazy_polymorphic_values, followed by scans over
+// all records. The record count can be given on the command line, the default is 1M.
+
+#include "lazy_polymorphic_value.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <vector>
+
+struct Record {
+    virtual ~Record() {}
+    virtual double weight() const { return 0; }
+};
+
+// Decoding does some work per byte, as parsing or decompression would.
+template<size_t N> struct Table : public Record {
+    Table(std::span<const std::byte> bytes) {
+        for (size_t i = 0; i < N; i++)
+            std::memcpy(&values[i], bytes.data() + i * sizeof(double), sizeof(double));
+        for (size_t i = 1; i < N; i++)
+            values[i] += values[i - 1] * 0.5;
+    }
+    double weight() const override { return values[N - 1]; }
+    double values[N];
+};
+
+using Poly = stdx::polymorphic_value<Record>;
+using Lazy = stdx::lazy_polymorphic_value<Record>;
+
+template<typename F> static double measure(const char* name, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    double ret = f();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ms << " ms (checksum " << ret << ")" << std::endl;
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    const size_t record_size = 32 * sizeof(double);
+
+    std::vector<std::byte> snapshot(count * record_size);
+    for (size_t i = 0; i < count * 32; i++) {
+        double v = double(i % 1000);
+        std::memcpy(snapshot.data() + i * sizeof(double), &v, sizeof(double));
+    }
+
+    stdx::polymorphic_type_registry<Record> registry;
+    registry.add<Table<4>>(0);
+    registry.add<Table<32>>(1);
+    auto record = [&](size_t i) { return std::span<const std::byte>(snapshot).subspan(i * record_size, record_size); };
+
+    std::vector<Poly> eager(count);
+    std::vector<Lazy> lazy;
+    lazy.reserve(count);
+    measure("eager load", [&] {
+        for (size_t i = 0; i < count; i++)
+            registry.decode(uint32_t(i % 2), record(i), eager[i]);
+        return 0.0;
+    });
+    measure("lazy load", [&] {
+        for (size_t i = 0; i < count; i++)
+            lazy.emplace_back(registry, uint32_t(i % 2), record(i));
+        return 0.0;
+    });
+
+    measure("lazy first scan, decodes", [&] {
+        double sum = 0;
+        for (const Lazy& r : lazy)
+            sum += r->weight();
+        return sum;
+    });
+    for (int round = 0; round < 2; round++) {
+        measure("polymorphic_value scan", [&] {
+            double sum = 0;
+            for (const Poly& r : eager)
+                sum += r->weight();
+            return sum;
+        });
+        measure("lazy_polymorphic_value scan", [&] {
+            double sum = 0;
+            for (const Lazy& r : lazy)
+                sum += r->weight();
+            return sum;
+        });
+    }
+}
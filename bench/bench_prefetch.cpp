@@ -0,0 +1,73 @@
+// Scan of a vector of polymorphic_values where half of the objects are heap allocated in random order, with a plain loop and with
+// for_each_prefetched at a few distances. The element count can be given on the command line, the default is 10M.
+
+#include "polymorphic_value.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+struct Shape {
+    virtual ~Shape() {}
+    virtual int64_t area() const { return 0; }
+};
+
+struct Square : public Shape {
+    Square(int64_t side) : side(side) {}
+    int64_t area() const override { return side * side; }
+    int64_t side;
+};
+
+struct Polygon : public Shape {
+    Polygon(int64_t v) { coordinates[0] = v; }
+    int64_t area() const override { return coordinates[0] + coordinates[7]; }
+    int64_t coordinates[12] = {};       // Does not fit the 16 byte SBO buffer.
+};
+
+using Poly = stdx::polymorphic_value<Shape, { .size = 16 }>;
+
+template<typename F> static void measure(const char* name, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    int64_t sum = f();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ms << " ms (checksum " << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+    std::vector<Poly> shapes;
+    shapes.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (i % 2 == 0)
+            shapes.emplace_back(std::in_place_type<Square>, int64_t(i));
+        else
+            shapes.emplace_back(std::in_place_type<Polygon>, int64_t(i));
+    }
+
+    // Shuffle so that consecutive elements point to unrelated heap blocks, as after a long running program has churned.
+    std::shuffle(shapes.begin(), shapes.end(), std::mt19937_64(42));
+
+    for (int round = 0; round < 2; round++) {
+        measure("plain loop", [&] {
+            int64_t sum = 0;
+            for (const Poly& s : shapes)
+                sum += s->area();
+            return sum;
+        });
+        for (size_t distance : { 4, 8, 16, 32 }) {
+            std::string name = "for_each_prefetched distance " + std::to_string(distance);
+            measure(name.c_str(), [&] {
+                int64_t sum = 0;
+                stdx::for_each_prefetched(shapes, distance, [&](const Poly& s) { sum += s->area(); });
+                return sum;
+            });
+        }
+    }
+}
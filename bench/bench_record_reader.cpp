@@ -0,0 +1,105 @@
+// Decoding throughput of a buffer of serialized records of two types, in GB/s. polymorphic_record_reader decodes into one reused
+// polymorphic_value and into batches of 64 values, the baseline creates a unique_ptr per record through a table of factory
+// functions. The record count can be given on the command line, the default is 4M.
+
+#include "polymorphic_record_reader.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <vector>
+
+struct Record {
+    virtual ~Record() {}
+    virtual double weight() const { return 0; }
+};
+
+struct Sample : public Record {
+    Sample(std::span<const std::byte> bytes) { std::memcpy(values, bytes.data(), sizeof(values)); }
+    double weight() const override { return values[0] + values[1]; }
+    double values[2];
+};
+
+struct Trade : public Record {
+    Trade(std::span<const std::byte> bytes) {
+        std::memcpy(&price, bytes.data(), sizeof(price));
+        std::memcpy(&quantity, bytes.data() + sizeof(price), sizeof(quantity));
+        std::memcpy(venue, bytes.data() + sizeof(price) + sizeof(quantity), sizeof(venue));
+    }
+    double weight() const override { return price * quantity; }
+    double price;
+    long quantity;
+    char venue[24];
+};
+
+using Reader = stdx::polymorphic_record_reader<Record>;
+
+template<typename F> static void measure(const char* name, size_t bytes, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    double sum = f();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << bytes / s / 1e9 << " GB/s (" << sum << ")" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4'000'000;
+
+    std::vector<std::byte> records;
+    std::byte payload[40] = {};
+    for (size_t i = 0; i < count; i++) {
+        double v = double(i % 100);
+        std::memcpy(payload, &v, sizeof(v));
+        if (i % 3 == 0)
+            Reader::append(records, 1, std::span(payload, 40));
+        else
+            Reader::append(records, 0, std::span(payload, 16));
+    }
+
+    stdx::polymorphic_type_registry<Record> registry;
+    registry.add<Sample>(0);
+    registry.add<Trade>(1);
+
+    using factory = std::unique_ptr<Record> (*)(std::span<const std::byte>);
+    factory factories[] = {
+        [](std::span<const std::byte> bytes) -> std::unique_ptr<Record> { return std::make_unique<Sample>(bytes); },
+        [](std::span<const std::byte> bytes) -> std::unique_ptr<Record> { return std::make_unique<Trade>(bytes); },
+    };
+
+    for (int round = 0; round < 2; round++) {
+        measure("unique_ptr per record", records.size(), [&] {
+            double sum = 0;
+            std::span<const std::byte> rest(records);
+            while (!rest.empty()) {
+                uint32_t header[2];
+                std::memcpy(header, rest.data(), sizeof(header));
+                std::unique_ptr<Record> r = factories[header[0]](rest.subspan(sizeof(header), header[1]));
+                sum += r->weight();
+                rest = rest.subspan(sizeof(header) + header[1]);
+            }
+            return sum;
+        });
+        measure("reused slot", records.size(), [&] {
+            double sum = 0;
+            Reader reader(registry, records);
+            Reader::value_type slot;
+            while (reader.read(slot))
+                sum += slot->weight();
+            return sum;
+        });
+        measure("batches of 64", records.size(), [&] {
+            double sum = 0;
+            Reader reader(registry, records);
+            std::vector<Reader::value_type> batch(64);
+            while (size_t n = reader.read(std::span(batch))) {
+                for (size_t i = 0; i < n; i++)
+                    sum += batch[i]->weight();
+            }
+            return sum;
+        });
+    }
+}
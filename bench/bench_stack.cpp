@@ -0,0 +1,96 @@
+// Push and pop of interpreter frames of three sizes in a random walk of the stack depth, using polymorphic_stack and using
+// std::vector<polymorphic_value<Frame>>. The largest frame does not fit the default SBO size, so the vector allocates for it.
+
+#include "polymorphic_stack.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+struct Frame {
+    virtual ~Frame() {}
+    virtual int64_t evaluate() const { return 0; }
+};
+
+struct ConstantFrame : public Frame {
+    ConstantFrame(int64_t v) : value(v) {}
+    int64_t evaluate() const override { return value; }
+    int64_t value;
+};
+
+struct CallFrame : public Frame {
+    CallFrame(int64_t v) { args[0] = v; }
+    int64_t evaluate() const override { return args[0] + 1; }
+    int64_t args[5] = {};
+};
+
+struct BlockFrame : public Frame {
+    BlockFrame(int64_t v) { locals[0] = v; }
+    int64_t evaluate() const override { return locals[0] * 2; }
+    int64_t locals[14] = {};
+};
+
+using Poly = stdx::polymorphic_value<Frame>;
+
+static const size_t operations = 20'000'000;
+
+// Deterministic random walk: push with probability 1/2 at depth 0 .. max_depth, pop otherwise.
+template<typename Push, typename Pop, typename Top> static int64_t run(Push push, Pop pop, Top top, size_t& depth)
+{
+    uint64_t state = 12345;
+    int64_t sum = 0;
+    for (size_t i = 0; i < operations; i++) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        uint64_t r = state >> 33;
+        if (depth == 0 || (r & 1) != 0) {
+            push(r % 3, int64_t(i));
+            depth++;
+        }
+        else {
+            sum += top();
+            pop();
+            depth--;
+        }
+    }
+    return sum;
+}
+
+template<typename F> static void measure(const char* name, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    int64_t sum = f();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ms << " ms (checksum " << sum << ")" << std::endl;
+}
+
+int main()
+{
+    measure("polymorphic_stack", [] {
+        stdx::polymorphic_stack<Frame> stack;
+        size_t depth = 0;
+        return run([&](uint64_t kind, int64_t v) {
+                       if (kind == 0)
+                           stack.emplace<ConstantFrame>(v);
+                       else if (kind == 1)
+                           stack.emplace<CallFrame>(v);
+                       else
+                           stack.emplace<BlockFrame>(v);
+                   },
+                   [&] { stack.pop(); }, [&] { return stack.top().evaluate(); }, depth);
+    });
+
+    measure("vector<polymorphic_value>", [] {
+        std::vector<Poly> stack;
+        size_t depth = 0;
+        return run([&](uint64_t kind, int64_t v) {
+                       if (kind == 0)
+                           stack.emplace_back(std::in_place_type<ConstantFrame>, v);
+                       else if (kind == 1)
+                           stack.emplace_back(std::in_place_type<CallFrame>, v);
+                       else
+                           stack.emplace_back(std::in_place_type<BlockFrame>, v);
+                   },
+                   [&] { stack.pop_back(); }, [&] { return stack.back()->evaluate(); }, depth);
+    });
+}
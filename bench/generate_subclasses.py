@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Generate a translation unit with many trivially copyable subclasses which are all emplaced, copied and moved in a
+polymorphic_value, for measuring code size and compile time of handler instantiation."""
+import argparse
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-n", "--count", type=int, default=1000, help="number of subclasses")
+    parser.add_argument("--share-handlers", action="store_true", help="set the share_handlers option")
+    parser.add_argument("--for-alias", action="store_true",
+                        help="also emplace each subclass in a polymorphic_value_for alias of all subclasses")
+    parser.add_argument("-o", "--output", required=True, help="generated source file")
+    args = parser.parse_args()
+
+    share = "true" if args.share_handlers else "false"
+    lines = [
+        "// Generated by generate_subclasses.py, do not edit.",
+        '#include "polymorphic_value.h"',
+        "",
+        "struct Base {",
+        "    int kind = 0;",
+        "};",
+        "",
+        "using Poly = stdx::polymorphic_value<Base, stdx::polymorphic_value_options{{ .size = 64, .share_handlers = {} }}>;".format(share),
+        "",
+    ]
+
+    # Eight different sizes so that shared handlers are instantiated once per size.
+    for i in range(args.count):
+        lines += [
+            "struct Sub{} : public Base {{".format(i),
+            "    int data[{}];".format(i % 8 + 1),
+            "};",
+            "",
+            "void use{}(Poly& p)".format(i),
+            "{",
+            "    p.emplace<Sub{}>();".format(i),
+            "    Poly q = p;",
+            "    p = std::move(q);",
+            "}",
+            "",
+        ]
+
+    if args.for_alias:
+        lines.append("using PolyFor = stdx::polymorphic_value_for<Base, {}>;".format(
+            ", ".join("Sub{}".format(i) for i in range(args.count))))
+        lines.append("")
+        for i in range(args.count):
+            lines += [
+                "void use_for{}(PolyFor& p)".format(i),
+                "{",
+                "    p.emplace<Sub{}>();".format(i),
+                "    PolyFor q = p;",
+                "    p = std::move(q);",
+                "}",
+                "",
+            ]
+        lines.append("void (*const uses_for[])(PolyFor&) = {")
+        lines += ["    use_for{},".format(i) for i in range(args.count)]
+        lines += ["};", ""]
+
+    lines.append("void (*const uses[])(Poly&) = {")
+    lines += ["    use{},".format(i) for i in range(args.count)]
+    lines += [
+        "};",
+        "",
+        "int main(int argc, char**)",
+        "{",
+        "    Poly p;",
+        "    uses[argc % {}](p);".format(args.count),
+    ]
+    if args.for_alias:
+        lines += [
+            "    PolyFor pf;",
+            "    uses_for[argc % {}](pf);".format(args.count),
+            "    return p->kind + pf->kind;",
+        ]
+    else:
+        lines.append("    return p->kind;")
+    lines += ["}", ""]
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+"""Generate translation units which each use polymorphic_value, either by including polymorphic_value.h or by importing the
+stdx.polymorphic_value module, for measuring the full rebuild time of a project."""
+import argparse
+import os
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-n", "--count", type=int, default=500, help="number of translation units")
+    parser.add_argument("--import", action="store_true", dest="use_import", help="import the module instead of including")
+    parser.add_argument("-o", "--output", required=True, help="output directory")
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+    for i in range(args.count):
+        if args.use_import:
+            # The headers GCC 12 needs before the import, see test_polymorphic_value_module.cpp.
+            head = ["#include <new>", "#include <tuple>", "#include <type_traits>", "#include <utility>", "",
+                    "import stdx.polymorphic_value;"]
+        else:
+            head = ['#include "polymorphic_value.h"']
+
+        lines = ["// Generated by generate_translation_units.py, do not edit."] + head + [
+            "",
+            "namespace tu{} {{".format(i),
+            "",
+            "struct Base {",
+            "    virtual ~Base() {}",
+            "    virtual int value() const { return 0; }",
+            "};",
+            "",
+            "struct Sub : public Base {",
+            "    int value() const override {{ return {}; }}".format(i),
+            "};",
+            "",
+            "}",
+            "",
+            "int use{}()".format(i),
+            "{",
+            "    stdx::polymorphic_value<tu{0}::Base> p(std::in_place_type<tu{0}::Sub>);".format(i),
+            "    auto q = p;",
+            "    return q->value();",
+            "}",
+            "",
+        ]
+        with open(os.path.join(args.output, "tu_{}.cpp".format(i)), "w") as f:
+            f.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
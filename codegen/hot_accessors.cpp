@@ -0,0 +1,82 @@
+// Small functions exercising the hot paths of polymorphic_value. scripts/check_codegen.py compiles this file at -O2, disassembles
+// it and checks each function against the budget in the comment before it, so that a lost optimization fails the build. The
+// budgets were set with GCC 12 for x86-64, where codegen_get_generation and codegen_prefetch use exactly their budgets. Other
+// compilers and versions may generate a few more instructions, in which case the budgets have to be revisited.
+
+#include "../polymorphic_value.h"
+
+#include <new>
+
+struct Base {
+    virtual ~Base() {}
+    virtual int value() const { return 0; }
+};
+
+struct Sub : public Base {
+    Sub(int v) : v(v) {}
+    int value() const override { return v; }
+    int v;
+};
+
+using Poly = stdx::polymorphic_value<Base>;
+
+// Access is one virtual call to the handler, which the compiler emits as a tail call.
+// codegen-budget: instructions=5 indirect=1
+extern "C" Base* codegen_get(Poly& p)
+{
+    return p.get();
+}
+
+// operator-> adds the virtual call of the called method itself.
+// codegen-budget: instructions=12 indirect=2
+extern "C" int codegen_arrow(const Poly& p)
+{
+    return p->value();
+}
+
+// Emplacing destroys the old object through the handler, then writes the constant handler vtable pointer and the new object.
+// codegen-budget: instructions=16 indirect=1
+extern "C" void codegen_emplace(Poly& p)
+{
+    p.emplace<Sub>(42);
+}
+
+// Constructing a fresh value knows the previous handler is empty, so no dispatch remains.
+// codegen-budget: instructions=8 indirect=0
+extern "C" void codegen_construct(void* where)
+{
+    new(where) Poly(std::in_place_type<Sub>, 42);
+}
+
+// Moving is one call to the source handler's relocate, which also destroys the source object.
+// codegen-budget: instructions=20 indirect=1
+extern "C" void codegen_move_construct(void* where, Poly& src)
+{
+    new(where) Poly(std::move(src));
+}
+
+using DirectPoly = stdx::polymorphic_value<Base, { .size = 16, .heap = false, .zero_offset = true }>;
+
+// With the zero_offset option get() only compares the handler with the empty handler.
+// codegen-budget: instructions=6 indirect=0
+extern "C" Base* codegen_get_zero_offset(DirectPoly& p)
+{
+    return p.get();
+}
+
+// Prefetching loads the first word of the buffer and prefetches it, without dispatching on the handler.
+// codegen-budget: instructions=3 indirect=0
+extern "C" void codegen_prefetch(const Poly& p)
+{
+    p.prefetch();
+}
+
+using CountedPoly = stdx::polymorphic_value<Base, { .generation = true }>;
+
+// The generation option adds an increment of the counter to non-const access. GCC also speculatively devirtualizes the call for the
+// empty handler here, which costs a compare and a branch but no dispatch.
+// codegen-budget: instructions=12 indirect=1
+extern "C" Base* codegen_get_generation(CountedPoly& p)
+{
+    return p.get();
+}
@@ -0,0 +1,130 @@
+/*
+
+polymorphic_value which is decoded from serialized bytes on first access. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_type_registry.h"
+
+#include <atomic>           // atomic, memory_order_acquire
+#include <cstdint>          // uint8_t, uint32_t
+#include <span>
+#include <utility>          // as_const
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// A polymorphic_value<T, Options> which is constructed from a type id and the serialized bytes of the object, and decoded by a
+/// polymorphic_type_registry on first access. Concurrent first accesses decode once, the other threads wait for the decoding thread.
+/// After that, access costs an acquire load and a predictable branch more than for a polymorphic_value. If the decoder throws the
+/// exception propagates and the next access tries again.
+///
+/// The bytes are not copied, they must stay valid until the value has been decoded, as is the case for a memory mapped snapshot.
+/// Copying, moving or assigning must not be concurrent with the first access of either operand. An undecoded source copies the
+/// encoding, so the copy is decoded separately.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class lazy_polymorphic_value {
+public:
+    using value_type = polymorphic_value<T, Options>;
+    using registry_type = polymorphic_type_registry<T, Options>;
+
+    lazy_polymorphic_value() : m_state(state::decoded) {}
+    lazy_polymorphic_value(const registry_type& registry, uint32_t type_id, span<const byte> bytes)
+        : m_registry(&registry), m_bytes(bytes), m_type_id(type_id) {}
+    explicit lazy_polymorphic_value(value_type value) : m_value(std::move(value)), m_state(state::decoded) {}
+
+    lazy_polymorphic_value(const lazy_polymorphic_value& src) requires is_copy_constructible_v<value_type>
+        : m_value(src.m_value), m_registry(src.m_registry), m_bytes(src.m_bytes), m_type_id(src.m_type_id),
+          m_state(src.m_state.load(memory_order_acquire)) {}
+    lazy_polymorphic_value(lazy_polymorphic_value&& src) requires is_move_constructible_v<value_type>
+        : m_value(std::move(src.m_value)), m_registry(src.m_registry), m_bytes(src.m_bytes), m_type_id(src.m_type_id),
+          m_state(src.m_state.load(memory_order_acquire)) {}
+
+    lazy_polymorphic_value& operator=(const lazy_polymorphic_value& src) requires is_copy_assignable_v<value_type> {
+        m_value = src.m_value;
+        assign_encoding(src);
+        return *this;
+    }
+    lazy_polymorphic_value& operator=(lazy_polymorphic_value&& src) requires is_move_assignable_v<value_type> {
+        m_value = std::move(src.m_value);
+        assign_encoding(src);
+        return *this;
+    }
+
+    // Access decodes the object if this has not been done yet. m_value is mutable for decoding, so const access goes through
+    // as_const to not count as a modification of the value, which would be a data race between readers.
+    T* get() { materialize(); return m_value.get(); }
+    const T* get() const { materialize(); return as_const(m_value).get(); }
+
+    T* operator->() { return get(); }
+    const T* operator->() const { return get(); }
+    T& operator*() { return *get(); }
+    const T& operator*() const { return *get(); }
+
+    // The decoded polymorphic_value.
+    value_type& value() { materialize(); return m_value; }
+    const value_type& value() const { materialize(); return m_value; }
+
+    // True if there is an object, which does not require decoding.
+    explicit operator bool() const { return decoded() ? bool(m_value) : m_registry != nullptr; }
+    bool decoded() const { return m_state.load(memory_order_acquire) == state::decoded; }
+
+    uint32_t type_id() const { return m_type_id; }
+    span<const byte> bytes() const { return m_bytes; }
+
+private:
+    enum class state : uint8_t { encoded, decoding, decoded };
+
+    void materialize() const {
+        if (m_state.load(memory_order_acquire) != state::decoded) [[unlikely]]
+            decode();
+    }
+
+    // The state works as a once flag which, unlike std::once_flag, can be reset when another encoding is assigned.
+    void decode() const {
+        state expected = state::encoded;
+        while (!m_state.compare_exchange_weak(expected, state::decoding, memory_order_acquire)) {
+            if (expected == state::decoded)
+                return;
+            if (expected == state::decoding)
+                m_state.wait(state::decoding, memory_order_acquire);
+            expected = state::encoded;
+        }
+
+        try {
+            m_registry->decode(m_type_id, m_bytes, m_value);
+        }
+        catch (...) {
+            m_state.store(state::encoded, memory_order_release);
+            m_state.notify_all();
+            throw;
+        }
+        m_state.store(state::decoded, memory_order_release);
+        m_state.notify_all();
+    }
+
+    void assign_encoding(const lazy_polymorphic_value& src) {
+        m_registry = src.m_registry;
+        m_bytes = src.m_bytes;
+        m_type_id = src.m_type_id;
+        m_state.store(src.m_state.load(memory_order_acquire), memory_order_release);
+    }
+
+    mutable value_type m_value;
+    const registry_type* m_registry = nullptr;
+    span<const byte> m_bytes;
+    uint32_t m_type_id = 0;
+    mutable atomic<state> m_state = state::encoded;
+};
+
+
+}       // Namespace std or stdx
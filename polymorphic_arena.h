@@ -0,0 +1,351 @@
+/*
+
+Arena of objects of different subclasses referred to by 32 bit handles, intended for trees such as ASTs. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_handler.h"
+
+#include <bit>              // has_single_bit, countr_zero
+#include <new>              // align_val_t
+#include <stdexcept>        // length_error
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Handle of an object in a polymorphic_arena. The untyped polymorphic_arena_handle<> is the base of the typed handles so that
+/// nodes can report their children regardless of the static types of the child handles. Handles are 4 bytes and only meaningful
+/// together with the arena that returned them.
+template<typename U = void> class polymorphic_arena_handle;
+
+template<> class polymorphic_arena_handle<void> {
+public:
+    polymorphic_arena_handle() = default;
+    explicit polymorphic_arena_handle(uint32_t bits) : m_bits(bits) {}
+
+    uint32_t bits() const { return m_bits; }
+    explicit operator bool() const { return m_bits != null_bits; }
+    bool operator==(const polymorphic_arena_handle&) const = default;
+
+protected:
+    static constexpr uint32_t null_bits = ~uint32_t(0);
+
+    uint32_t m_bits = null_bits;
+};
+
+template<typename U> class polymorphic_arena_handle : public polymorphic_arena_handle<> {
+public:
+    polymorphic_arena_handle() = default;
+    explicit polymorphic_arena_handle(polymorphic_arena_handle<> h) : polymorphic_arena_handle<>(h) {}
+
+    // Handles convert implicitly to handles of base classes.
+    template<typename D> polymorphic_arena_handle(polymorphic_arena_handle<D> h) requires is_base_of_v<U, D>
+        : polymorphic_arena_handle<>(h) {}
+};
+
+
+/// Callback which nodes call for each of their child handles, see polymorphic_arena::visit and clone. The callback may replace the
+/// handle.
+struct polymorphic_arena_visitor {
+    virtual void operator()(polymorphic_arena_handle<>& child) = 0;
+};
+
+// Ts which implement this can be used with polymorphic_arena::visit and clone.
+template<typename T> concept polymorphic_arena_node = requires(T & node, polymorphic_arena_visitor & visitor) {
+    node.for_each_child(visitor);
+};
+
+
+/// Storage for objects of subclasses of T which are stored back to back at their own size in polymorphic_elements, in chunks of
+/// ChunkSize bytes which are never moved. Objects are referred to by polymorphic_arena_handles which contain the chunk number and
+/// the offset of the object in units of 8 bytes, so a tree linked by handles uses 4 bytes per edge instead of a full polymorphic_value,
+/// and nodes created together are adjacent in memory.
+///
+/// Objects can't be removed individually, they are destroyed together by clear() or the destructor. A copy of an arena has the same
+/// layout so handles into the original are valid in the copy. The copy option enables copying of the arena and clone, and objects
+/// are never moved, also not when the arena is moved, so the move option only checks that each U is movable. The alignment option
+/// raises the alignment of the chunks for Us which need more than T.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}, size_t ChunkSize = 65536>
+class polymorphic_arena {
+    using element = polymorphic_element<T>;
+
+    static const size_t alignment = max({ alignof(T), Options.alignment, alignof(element) });
+    static const bool copyable = Options.copy && is_copy_constructible_v<T>;
+    static const bool movable = Options.move && is_move_constructible_v<T>;
+
+    static_assert(has_single_bit(ChunkSize) && ChunkSize >= 1024, "ChunkSize must be a power of 2 of at least 1024");
+
+public:
+    template<typename U = void> using handle = polymorphic_arena_handle<U>;
+    using value_type = T;
+    using size_type = size_t;
+
+    polymorphic_arena() {}
+    polymorphic_arena(const polymorphic_arena& src) requires copyable {
+        try {
+            for (const chunk& c : src.m_chunks) {
+                add_chunk(c.capacity);
+                chunk& dest = m_chunks.back();
+                for (size_t pos = 0; pos < c.used; pos = next(c, pos)) {
+                    c.element_at(pos)->copy_to(dest.data + pos);
+                    dest.used = next(c, pos);
+                    m_size++;
+                }
+            }
+        }
+        catch (...) {
+            // The used sizes only cover the objects which were copied, so release destroys exactly those.
+            release();
+            throw;
+        }
+        m_current = src.m_current;
+    }
+    polymorphic_arena(polymorphic_arena&& src)
+        : m_chunks(std::move(src.m_chunks)), m_current(exchange(src.m_current, no_chunk)), m_size(exchange(src.m_size, 0)) {
+        src.m_chunks.clear();
+    }
+
+    ~polymorphic_arena() { release(); }
+
+    polymorphic_arena& operator=(const polymorphic_arena& src) requires copyable {
+        if (this != &src) {
+            polymorphic_arena copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_arena& operator=(polymorphic_arena&& src) {
+        if (this != &src) {
+            release();
+            m_chunks = std::move(src.m_chunks);
+            src.m_chunks.clear();
+            m_current = exchange(src.m_current, no_chunk);
+            m_size = exchange(src.m_size, 0);
+        }
+        return *this;
+    }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    // Bytes used by objects including element headers and padding, and bytes allocated.
+    size_t bytes_used() const {
+        size_t ret = 0;
+        for (const chunk& c : m_chunks)
+            ret += c.used;
+        return ret;
+    }
+    size_t bytes_allocated() const {
+        size_t ret = 0;
+        for (const chunk& c : m_chunks)
+            ret += c.capacity;
+        return ret;
+    }
+
+    // Construct a U in the arena and return its handle.
+    template<typename U = T, typename... Args> handle<U> emplace(Args&&... args) requires is_base_of_v<T, U> {
+        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
+        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the move option must be set to false");
+        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
+
+        auto [chunk_index, pos] = place(sizeof(U), alignof(U));
+        chunk& c = m_chunks[chunk_index];
+        element::template construct_at<U>(c.data + pos, forward<Args>(args)...);
+        c.used = next(c, pos);
+        m_size++;
+        return handle<U>(handle<>(make_handle(chunk_index, pos)));
+    }
+
+    // The object type of a handle<U>, where untyped handles refer to a T.
+    template<typename U> using object_type = conditional_t<is_void_v<U>, T, U>;
+
+    // Access the object of a handle, which must have been returned by this arena.
+    template<typename U> object_type<U>& operator[](handle<U> h) { return *get(h); }
+    template<typename U> const object_type<U>& operator[](handle<U> h) const { return *get(h); }
+
+    // Returns nullptr for the null handle.
+    template<typename U> object_type<U>* get(handle<U> h) {
+        if (!h)
+            return nullptr;
+        return static_cast<object_type<U>*>(element_of(h)->get());
+    }
+    template<typename U> const object_type<U>* get(handle<U> h) const { return const_cast<polymorphic_arena*>(this)->get(h); }
+
+    // Call f with each object in the order they were created, which is also their order in memory.
+    template<typename F> void for_each(F&& f) {
+        for (chunk& c : m_chunks) {
+            for (size_t pos = 0; pos < c.used; pos = next(c, pos))
+                f(*c.element_at(pos)->get());
+        }
+    }
+
+    // Call f with each node of the tree at root and its handle, parents before children and children in the order for_each_child
+    // reports them.
+    template<typename F> void visit(handle<> root, F&& f) requires polymorphic_arena_node<T> {
+        struct collector : public polymorphic_arena_visitor {
+            void operator()(polymorphic_arena_handle<>& child) override { children.push_back(child); }
+            vector<handle<>> children;
+        } pending;
+
+        if (root)
+            pending.children.push_back(root);
+        while (!pending.children.empty()) {
+            handle<> h = pending.children.back();
+            pending.children.pop_back();
+            T& node = *get(h);
+            f(node, h);
+
+            // Children are pushed in order, reverse them so the first child is visited first.
+            size_t first = pending.children.size();
+            node.for_each_child(pending);
+            reverse(pending.children.begin() + first, pending.children.end());
+        }
+    }
+
+    // Copy the tree at root, returning the handle of the new root. The nodes of the copy are adjacent in memory. If a copy throws, the
+    // nodes copied before it stay in the arena until it is cleared or destroyed.
+    template<typename U> handle<U> clone(handle<U> root) requires copyable && polymorphic_arena_node<T> {
+        struct cloner : public polymorphic_arena_visitor {
+            cloner(polymorphic_arena& arena) : arena(arena) {}
+
+            void operator()(polymorphic_arena_handle<>& child) override {
+                if (child) {
+                    child = arena.copy_node(child);
+                    pending.push_back(child);
+                }
+            }
+            polymorphic_arena& arena;
+            vector<handle<>> pending;       // Copied nodes whose children have not been copied yet.
+        } copier(*this);
+
+        if (!root)
+            return root;
+
+        handle<U> ret(copy_node(root));
+        copier.pending.push_back(ret);
+        while (!copier.pending.empty()) {
+            handle<> h = copier.pending.back();
+            copier.pending.pop_back();
+            get(h)->for_each_child(copier);
+        }
+        return ret;
+    }
+
+    // Destroy all objects. The first chunk is kept.
+    void clear() {
+        destroy_objects();
+        while (m_chunks.size() > 1) {
+            free(m_chunks.back());
+            m_chunks.pop_back();
+        }
+        if (!m_chunks.empty()) {
+            m_chunks.front().used = 0;
+            m_current = 0;
+        }
+        m_size = 0;
+    }
+
+private:
+    static constexpr size_t unit = 8;       // Handle offset granularity, at least the alignment of polymorphic_element.
+    static constexpr uint32_t offset_bits = countr_zero(ChunkSize / unit);
+    static constexpr size_t no_chunk = ~size_t(0);
+
+    static_assert(alignof(element) <= unit);
+
+    struct chunk {
+        const element* element_at(size_t pos) const { return std::launder(reinterpret_cast<const element*>(data + pos)); }
+        element* element_at(size_t pos) { return std::launder(reinterpret_cast<element*>(data + pos)); }
+
+        byte* data;
+        size_t used = 0;
+        size_t capacity;
+    };
+
+    static size_t next(const chunk& c, size_t pos) { return (pos + c.element_at(pos)->extent() + unit - 1) & ~(unit - 1); }
+
+    static uint32_t make_handle(size_t chunk_index, size_t pos) { return uint32_t(chunk_index << offset_bits | pos / unit); }
+
+    element* element_of(handle<> h) {
+        uint32_t bits = h.bits();
+        return m_chunks[bits >> offset_bits].element_at((bits & ((1u << offset_bits) - 1)) * unit);
+    }
+
+    // Find room for an element holding an object of the given size and alignment. Objects which would not fit an empty chunk get a
+    // chunk of their own, which does not become the current chunk, so handle offsets always fit in offset_bits.
+    pair<size_t, size_t> place(size_t size, size_t object_alignment) {
+        if (m_current != no_chunk) {
+            chunk& c = m_chunks[m_current];
+            if (c.used + element::extent_at(c.data + c.used, size, object_alignment) <= c.capacity)
+                return { m_current, c.used };
+        }
+
+        size_t needed = sizeof(element) + object_alignment + size;
+        if (m_chunks.size() >= (size_t(1) << (32 - offset_bits)) - 1)
+            throw length_error("polymorphic_arena: too many chunks");
+
+        if (needed > ChunkSize) {
+            add_chunk((needed + unit - 1) & ~(unit - 1));
+            return { m_chunks.size() - 1, 0 };
+        }
+        add_chunk(ChunkSize);
+        m_current = m_chunks.size() - 1;
+        return { m_current, 0 };
+    }
+
+    // The chunk is added before its memory is allocated, so that the memory can't leak if push_back throws.
+    void add_chunk(size_t capacity) {
+        m_chunks.push_back({ nullptr, 0, capacity });
+        try {
+            m_chunks.back().data = static_cast<byte*>(operator new(capacity, align_val_t(alignment)));
+        }
+        catch (...) {
+            m_chunks.pop_back();
+            throw;
+        }
+    }
+    static void free(chunk& c) { operator delete(c.data, align_val_t(alignment)); }
+
+    handle<> copy_node(handle<> h) {
+        const element* src = element_of(h);
+        auto [chunk_index, pos] = place(src->size(), src->alignment());
+        chunk& c = m_chunks[chunk_index];
+        src->copy_to(c.data + pos);
+        c.used = next(c, pos);
+        m_size++;
+        return handle<>(make_handle(chunk_index, pos));
+    }
+
+    void destroy_objects() {
+        for (chunk& c : m_chunks) {
+            for (size_t pos = 0; pos < c.used; pos = next(c, pos))
+                c.element_at(pos)->destroy();
+        }
+    }
+
+    void release() {
+        destroy_objects();
+        for (chunk& c : m_chunks)
+            free(c);
+        m_chunks.clear();
+        m_current = no_chunk;
+        m_size = 0;
+    }
+
+    vector<chunk> m_chunks;
+    size_t m_current = no_chunk;        // The chunk where objects are added, oversized chunks are never current.
+    size_t m_size = 0;
+};
+
+
+}       // Namespace std or stdx
@@ -0,0 +1,112 @@
+/*
+
+Type erased awaitable which stores small awaiters inline, for coroutines awaiting operations selected at runtime. See README.md for
+details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <concepts>         // convertible_to
+#include <coroutine>        // coroutine_handle, noop_coroutine
+#include <exception>        // terminate
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+// Awaiters which can be stored in a polymorphic_awaitable<R>. await_suspend must accept a coroutine_handle<> as the awaiting
+// coroutine's promise type is erased.
+template<typename A, typename R> concept polymorphic_awaiter = requires(A& a, coroutine_handle<> awaiting) {
+    { a.await_ready() } -> convertible_to<bool>;
+    a.await_suspend(awaiting);
+    { a.await_resume() } -> convertible_to<R>;
+};
+
+
+/// The interface which polymorphic_awaitable calls through its polymorphic_value. await_suspend returns the coroutine to resume,
+/// which covers the void, bool and coroutine_handle returning forms of the awaiters. The class is not abstract, as polymorphic_value
+/// is only movable if T is, but only polymorphic_awaiter_for objects are stored.
+template<typename R> struct polymorphic_awaiter_base {
+    virtual ~polymorphic_awaiter_base() {}
+
+    virtual bool await_ready() { return false; }
+    virtual coroutine_handle<> await_suspend(coroutine_handle<> awaiting) { return noop_coroutine(); }
+    virtual R await_resume() { terminate(); }
+};
+
+template<typename R, typename A> struct polymorphic_awaiter_for final : public polymorphic_awaiter_base<R> {
+    template<typename... Args> polymorphic_awaiter_for(Args&&... args) : awaiter(forward<Args>(args)...) {}
+
+    bool await_ready() override { return awaiter.await_ready(); }
+
+    // Returning noop_coroutine suspends the awaiting coroutine and returning it resumes it, as for true and false from a bool
+    // await_suspend.
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) override {
+        using result = decltype(awaiter.await_suspend(awaiting));
+        if constexpr (is_void_v<result>) {
+            awaiter.await_suspend(awaiting);
+            return noop_coroutine();
+        }
+        else if constexpr (is_same_v<result, bool>)
+            return awaiter.await_suspend(awaiting) ? coroutine_handle<>(noop_coroutine()) : awaiting;
+        else
+            return awaiter.await_suspend(awaiting);
+    }
+
+    R await_resume() override { return awaiter.await_resume(); }
+
+    A awaiter;
+};
+
+
+/// Awaitable holding an awaiter of any type A which satisfies polymorphic_awaiter<A, R>, so that a coroutine can co_await an
+/// operation selected at runtime. The awaiter is stored in a polymorphic_value<polymorphic_awaiter_base<R>, Options>, inline if
+/// it fits the SBO buffer, so unlike a unique_ptr to an awaiter interface an await does not allocate. Each of the three await
+/// functions costs two indirect calls, the handler's get() and the awaiter's virtual function. With heap = false and zero_offset
+/// the get() call is avoided.
+///
+/// The default options do not require awaiters to be copyable. Set heap to false to make an awaiter which does not fit a compile
+/// time error. Awaiting an empty polymorphic_awaitable is undefined behaviour.
+template<typename R, polymorphic_value_options Options = polymorphic_value_options{ .copy = false }> class polymorphic_awaitable {
+public:
+    using value_type = polymorphic_value<polymorphic_awaiter_base<R>, Options>;
+
+    polymorphic_awaitable() {}
+    template<typename A, typename... Args> explicit polymorphic_awaitable(in_place_type_t<A>, Args&&... args)
+        requires polymorphic_awaiter<A, R> {
+        emplace<A>(forward<Args>(args)...);
+    }
+    template<typename A> polymorphic_awaitable(A&& awaiter)
+        requires (!is_same_v<remove_cvref_t<A>, polymorphic_awaitable>) && polymorphic_awaiter<remove_cvref_t<A>, R> {
+        emplace<remove_cvref_t<A>>(forward<A>(awaiter));
+    }
+
+    // Construct an A, replacing any previous awaiter, and return it.
+    template<typename A, typename... Args> A& emplace(Args&&... args) requires polymorphic_awaiter<A, R> {
+        m_value.template emplace<polymorphic_awaiter_for<R, A>>(forward<Args>(args)...);
+        return static_cast<polymorphic_awaiter_for<R, A>&>(*m_value).awaiter;
+    }
+
+    void reset() { m_value.reset(); }
+    explicit operator bool() const { return bool(m_value); }
+
+    bool await_ready() { return m_value->await_ready(); }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) { return m_value->await_suspend(awaiting); }
+    R await_resume() { return m_value->await_resume(); }
+
+private:
+    value_type m_value;
+};
+
+
+}       // Namespace std or stdx
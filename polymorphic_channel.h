@@ -0,0 +1,174 @@
+/*
+
+Bounded channel of polymorphic messages between coroutines on one thread. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <coroutine>        // coroutine_handle
+#include <tuple>            // apply, forward_as_tuple
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Where a polymorphic_channel sends the coroutines whose send or receive has completed while they were suspended. An event loop
+/// implements this by queueing the handle and resuming it later.
+struct polymorphic_channel_scheduler {
+    virtual void schedule(coroutine_handle<> h) = 0;
+};
+
+
+/// Channel of messages of subclasses of T, each stored in a polymorphic_value<T, Options> in a ring of Capacity slots inside the
+/// channel. `co_await send<U>(args...)` constructs a U in the ring and suspends while the ring is full, `co_await receive()`
+/// suspends while it is empty and returns the oldest message. Messages which fit the SBO buffer are never allocated.
+///
+/// The channel is for coroutines on one thread and has no synchronization. Suspended senders and receivers are queued in the order
+/// they arrived. When a receive frees a slot the first waiting sender's message is constructed in it right away, from the arguments
+/// kept in the sender's suspended co_await expression, and the sender is passed to the scheduler. Likewise a send to a channel
+/// with waiting receivers moves the message to the first receiver, which then resumes from the scheduler.
+template<typename T, size_t Capacity, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_channel {
+    static_assert(Capacity > 0, "A channel must have room for at least one message");
+
+    // Suspended senders and receivers form intrusive FIFO lists, so waiting does not allocate either.
+    struct waiter {
+        coroutine_handle<> m_handle;
+        waiter* m_next = nullptr;
+    };
+    struct waiter_list {
+        void push(waiter* w) {
+            w->m_next = nullptr;
+            (m_tail == nullptr ? m_head : m_tail->m_next) = w;
+            m_tail = w;
+        }
+        waiter* pop() {
+            waiter* ret = m_head;
+            m_head = ret->m_next;
+            if (m_head == nullptr)
+                m_tail = nullptr;
+            return ret;
+        }
+        bool empty() const { return m_head == nullptr; }
+
+        waiter* m_head = nullptr;
+        waiter* m_tail = nullptr;
+    };
+
+public:
+    using value_type = polymorphic_value<T, Options>;
+
+    // A suspended sender constructs its message through this virtual call, which knows U and the arguments.
+    struct sender : public waiter {
+        virtual void put(value_type& slot) = 0;
+    };
+
+    template<typename U, typename... Args> class send_awaiter : public sender {
+    public:
+        bool await_ready() {
+            if (!m_channel.m_senders.empty() || m_channel.full())
+                return false;
+            m_channel.push(*this);
+            return true;
+        }
+        void await_suspend(coroutine_handle<> h) {
+            this->m_handle = h;
+            m_channel.m_senders.push(this);
+        }
+        void await_resume() {}
+
+        void put(value_type& slot) override {
+            apply([&slot](Args&&... args) { slot.template emplace<U>(forward<Args>(args)...); }, std::move(m_args));
+        }
+
+    private:
+        friend class polymorphic_channel;
+
+        send_awaiter(polymorphic_channel& channel, Args&&... args) : m_channel(channel), m_args(forward<Args>(args)...) {}
+
+        polymorphic_channel& m_channel;
+        tuple<Args&&...> m_args;
+    };
+
+    class receive_awaiter : public waiter {
+    public:
+        bool await_ready() {
+            if (m_channel.empty())
+                return false;
+            m_channel.pop(m_message);
+            return true;
+        }
+        void await_suspend(coroutine_handle<> h) {
+            this->m_handle = h;
+            m_channel.m_receivers.push(this);
+        }
+        value_type await_resume() { return std::move(m_message); }
+
+    private:
+        friend class polymorphic_channel;
+
+        receive_awaiter(polymorphic_channel& channel) : m_channel(channel) {}
+
+        polymorphic_channel& m_channel;
+        value_type m_message;
+    };
+
+    explicit polymorphic_channel(polymorphic_channel_scheduler& scheduler) : m_scheduler(scheduler) {}
+    polymorphic_channel(const polymorphic_channel&) = delete;
+    polymorphic_channel& operator=(const polymorphic_channel&) = delete;
+
+    bool empty() const { return m_size == 0; }
+    bool full() const { return m_size == Capacity; }
+    size_t size() const { return m_size; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    // The awaiters refer to args, which must live until the co_await completes, as temporaries in the co_await expression do.
+    template<typename U = T, typename... Args> send_awaiter<U, Args...> send(Args&&... args) requires is_base_of_v<T, U> {
+        return send_awaiter<U, Args...>(*this, forward<Args>(args)...);
+    }
+    receive_awaiter receive() { return receive_awaiter(*this); }
+
+private:
+    // Construct a message at the back of the ring, which must not be full, and hand it to the first waiting receiver if any.
+    void push(sender& s) {
+        s.put(m_slots[(m_head + m_size) % Capacity]);
+        m_size++;
+        if (!m_receivers.empty()) {
+            receive_awaiter* r = static_cast<receive_awaiter*>(m_receivers.pop());
+            pop(r->m_message);
+            m_scheduler.schedule(r->m_handle);
+        }
+    }
+
+    // Move the oldest message to dest and let the first waiting sender fill the freed slot.
+    void pop(value_type& dest) {
+        dest = std::move(m_slots[m_head]);
+        m_head = (m_head + 1) % Capacity;
+        m_size--;
+        if (!m_senders.empty()) {
+            sender* s = static_cast<sender*>(m_senders.pop());
+            s->put(m_slots[(m_head + m_size) % Capacity]);
+            m_size++;
+            m_scheduler.schedule(s->m_handle);
+        }
+    }
+
+    polymorphic_channel_scheduler& m_scheduler;
+    value_type m_slots[Capacity];
+    size_t m_head = 0;
+    size_t m_size = 0;
+    waiter_list m_senders;
+    waiter_list m_receivers;
+};
+
+
+}       // Namespace std or stdx
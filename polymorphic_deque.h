@@ -0,0 +1,316 @@
+/*
+
+Segmented queue of objects of different subclasses, each stored at its own size. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_handler.h"
+
+#include <iterator>         // forward_iterator_tag
+#include <new>              // align_val_t
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Queue of objects of subclasses of T where each object is stored in a polymorphic_element at its own size, back to back in chunks
+/// of ChunkSize bytes. Elements are never moved, so pointers and references stay valid until the element is popped. push_back and
+/// pop_front are O(1) and chunks which are emptied by pop_front are kept in a free list, so a queue which does not grow beyond its
+/// previous maximum size does not allocate.
+///
+/// With the copy option the deque can be copied, which copies the elements into new chunks in the same order. Moving the deque
+/// only moves the chunk pointers, so the move option only requires each U to be movable. The chunks are aligned for the largest of
+/// alignof(T) and the alignment option, and a U with a larger alignment is a compile time error. A U which is larger than
+/// ChunkSize gets a chunk of its own.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}, size_t ChunkSize = 4096>
+class polymorphic_deque {
+    using element = polymorphic_element<T>;
+
+    static const size_t alignment = max({ alignof(T), Options.alignment, alignof(element) });
+    static const bool copyable = Options.copy && is_copy_constructible_v<T>;
+    static const bool movable = Options.move && is_move_constructible_v<T>;
+
+    struct chunk;
+
+    static_assert(ChunkSize % alignof(element) == 0, "ChunkSize must be a multiple of the alignment of polymorphic_element");
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+
+    template<bool Const> class basic_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = T;
+        using reference = conditional_t<Const, const T&, T&>;
+        using pointer = conditional_t<Const, const T*, T*>;
+
+        basic_iterator() = default;
+        template<bool C = Const> requires C basic_iterator(const basic_iterator<false>& rhs) : m_chunk(rhs.m_chunk), m_pos(rhs.m_pos) {}
+
+        reference operator*() const { return *element_at(m_pos)->get(); }
+        pointer operator->() const { return element_at(m_pos)->get(); }
+
+        basic_iterator& operator++() {
+            m_pos = next(m_pos);
+            skip_chunk_end();
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const basic_iterator& rhs) const { return m_pos == rhs.m_pos; }
+
+    private:
+        friend class polymorphic_deque;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(chunk* c, byte* pos) : m_chunk(c), m_pos(pos) { skip_chunk_end(); }
+
+        void skip_chunk_end() {
+            while (m_chunk != nullptr && m_pos == m_chunk->m_end && m_chunk->m_next != nullptr) {
+                m_chunk = m_chunk->m_next;
+                m_pos = m_chunk->begin();
+            }
+        }
+
+        chunk* m_chunk = nullptr;
+        byte* m_pos = nullptr;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    polymorphic_deque() {}
+    polymorphic_deque(const polymorphic_deque& src) requires copyable {
+        try {
+            for (const element* e : src.elements()) {
+                byte* where = place(e->size(), e->alignment());
+                commit(e->copy_to(where));
+            }
+        }
+        catch (...) {
+            release();
+            throw;
+        }
+    }
+    polymorphic_deque(polymorphic_deque&& src) { steal(src); }
+
+    ~polymorphic_deque() { release(); }
+
+    polymorphic_deque& operator=(const polymorphic_deque& src) requires copyable {
+        if (this != &src) {
+            polymorphic_deque copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_deque& operator=(polymorphic_deque&& src) {
+        if (this != &src) {
+            release();
+            steal(src);
+        }
+        return *this;
+    }
+
+    iterator begin() { return iterator(m_head, m_head_pos); }
+    iterator end() { return m_tail == nullptr ? iterator() : iterator(m_tail, m_tail->m_end); }
+    const_iterator begin() const { return const_cast<polymorphic_deque*>(this)->begin(); }
+    const_iterator end() const { return const_cast<polymorphic_deque*>(this)->end(); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    T& front() { return *begin(); }
+    const T& front() const { return *begin(); }
+    T& back() { return *m_back->get(); }
+    const T& back() const { return *m_back->get(); }
+
+    // Construct a U after the last element.
+    template<typename U = T, typename... Args> U& emplace_back(Args&&... args) requires is_base_of_v<T, U> {
+        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
+        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the move option must be set to false");
+        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
+
+        byte* where = place(sizeof(U), alignof(U));
+        element* e = element::template construct_at<U>(where, forward<Args>(args)...);
+        commit(e);
+        return *static_cast<U*>(e->object());
+    }
+    template<typename U> void push_back(U&& object) requires is_base_of_v<T, remove_cvref_t<U>> {
+        emplace_back<remove_cvref_t<U>>(forward<U>(object));
+    }
+
+    void pop_front() {
+        element* e = element_at(m_head_pos);
+        e->destroy();
+        m_head_pos = next(m_head_pos);
+        if (--m_size == 0)
+            reset();
+        else {
+            while (m_head_pos == m_head->m_end) {
+                chunk* c = m_head;
+                m_head = c->m_next;
+                m_head_pos = m_head->begin();
+                recycle(c);
+            }
+        }
+    }
+
+    void clear() {
+        for (element* e : elements())
+            e->destroy();
+        m_size = 0;
+        reset();
+    }
+
+    // Free the chunks kept for reuse.
+    void shrink_to_fit() {
+        free_chunks(m_free);
+        m_free = nullptr;
+    }
+
+private:
+    // Chunks form a singly linked list from the head to the tail. The elements of a chunk are between begin() and m_end.
+    struct chunk {
+        chunk(size_t capacity) : m_end(begin()), m_limit(begin() + capacity) {}
+
+        byte* begin() { return reinterpret_cast<byte*>(this) + header_size; }
+        size_t capacity() const { return m_limit - const_cast<chunk*>(this)->begin(); }
+
+        chunk* m_next = nullptr;
+        byte* m_end;
+        byte* m_limit;
+    };
+
+    static constexpr size_t header_size = (sizeof(chunk) + alignment - 1) / alignment * alignment;
+
+    static element* element_at(byte* pos) { return std::launder(reinterpret_cast<element*>(pos)); }
+    static byte* align(byte* pos) {
+        return reinterpret_cast<byte*>((reinterpret_cast<uintptr_t>(pos) + alignof(element) - 1) & ~(alignof(element) - 1));
+    }
+    static byte* next(byte* pos) { return align(pos + element_at(pos)->extent()); }
+
+    // Find room for an element holding an object of the given size and alignment, adding a chunk if the tail is full.
+    byte* place(size_t size, size_t object_alignment) {
+        if (m_tail != nullptr) {
+            byte* where = m_tail->m_end;
+            if (where + element::extent_at(where, size, object_alignment) <= m_tail->m_limit)
+                return where;
+        }
+
+        chunk* c = new_chunk(size + object_alignment + sizeof(element));
+        if (m_tail == nullptr) {
+            m_head = c;
+            m_head_pos = c->begin();
+        }
+        else
+            m_tail->m_next = c;
+        m_tail = c;
+        return c->begin();
+    }
+
+    // Called after an element has been constructed where place() returned.
+    void commit(element* e) {
+        m_tail->m_end = align(reinterpret_cast<byte*>(e) + e->extent());
+        m_back = e;
+        m_size++;
+    }
+
+    // Called when the last element has been popped. Keeps the head chunk and recycles the rest.
+    void reset() {
+        if (m_head == nullptr)
+            return;
+
+        chunk* rest = exchange(m_head->m_next, nullptr);
+        while (rest != nullptr)
+            recycle(exchange(rest, rest->m_next));
+
+        m_head->m_end = m_head_pos = m_head->begin();
+        m_tail = m_head;
+        m_back = nullptr;
+    }
+
+    chunk* new_chunk(size_t needed) {
+        if (needed <= ChunkSize && m_free != nullptr) {
+            chunk* c = exchange(m_free, m_free->m_next);
+            c->m_next = nullptr;
+            c->m_end = c->begin();
+            return c;
+        }
+
+        size_t capacity = max((needed + alignof(element) - 1) / alignof(element) * alignof(element), ChunkSize);
+        void* storage = operator new(header_size + capacity, align_val_t(alignment));
+        return new(storage) chunk(capacity);
+    }
+
+    // Chunks of the standard size are kept for reuse, larger chunks are freed.
+    void recycle(chunk* c) {
+        if (c->capacity() == ChunkSize) {
+            c->m_next = m_free;
+            m_free = c;
+        }
+        else
+            operator delete(c, align_val_t(alignment));
+    }
+
+    static void free_chunks(chunk* c) {
+        while (c != nullptr)
+            operator delete(exchange(c, c->m_next), align_val_t(alignment));
+    }
+
+    // Destroy the elements and free all chunks, leaving dangling chunk pointers which steal or the destructor replaces.
+    void release() {
+        clear();
+        free_chunks(m_head);
+        free_chunks(m_free);
+    }
+
+    void steal(polymorphic_deque& src) {
+        m_head = exchange(src.m_head, nullptr);
+        m_tail = exchange(src.m_tail, nullptr);
+        m_free = exchange(src.m_free, nullptr);
+        m_head_pos = exchange(src.m_head_pos, nullptr);
+        m_back = exchange(src.m_back, nullptr);
+        m_size = exchange(src.m_size, 0);
+    }
+
+    // Range of the elements for internal loops.
+    struct element_range {
+        struct cursor {
+            element* operator*() const { return element_at(m_it.m_pos); }
+            cursor& operator++() { ++m_it; return *this; }
+            bool operator!=(const cursor& rhs) const { return m_it != rhs.m_it; }
+            iterator m_it;
+        };
+        cursor begin() const { return { m_deque->begin() }; }
+        cursor end() const { return { m_deque->end() }; }
+        polymorphic_deque* m_deque;
+    };
+    element_range elements() const { return { const_cast<polymorphic_deque*>(this) }; }
+
+    chunk* m_head = nullptr;
+    chunk* m_tail = nullptr;
+    chunk* m_free = nullptr;
+    byte* m_head_pos = nullptr;     // The first element, in m_head.
+    element* m_back = nullptr;
+    size_t m_size = 0;
+};
+
+
+}       // Namespace std or stdx
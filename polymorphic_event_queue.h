@@ -0,0 +1,173 @@
+/*
+
+Discrete event queue of polymorphic events stored in stable slots, ordered by a radix heap of keys. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <bit>              // countl_zero
+#include <cstdint>          // uint32_t, uint64_t
+#include <memory>           // unique_ptr
+#include <stdexcept>        // invalid_argument, length_error
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Priority queue of events of subclasses of T with unsigned 64 bit timestamps, for discrete event simulation. Each event is
+/// constructed by schedule<U>(time, args...) in a polymorphic_value<T, Options> slot, in chunks of ChunkSize slots which are never
+/// moved, and stays there until dispatch has called the handler with it. The ordering is done by a radix heap of 16 byte (time,
+/// slot) keys, so the events themselves are never moved by heap operations, unlike in a priority_queue of polymorphic_values.
+///
+/// A radix heap is monotone: an event can't be scheduled before the time of the last dispatched event, now(), which is what a
+/// simulation needs. schedule throws invalid_argument for such a time. Keys are kept in 65 buckets by the highest bit in which
+/// they differ from now(), and a bucket is only redistributed when the earlier buckets are empty, which gives O(1) schedule and
+/// amortized O(log of the time range) dispatch. Events with equal times are dispatched in an unspecified but deterministic order.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}, size_t ChunkSize = 256>
+class polymorphic_event_queue {
+public:
+    using value_type = polymorphic_value<T, Options>;
+    using time_type = uint64_t;
+    using size_type = size_t;
+
+    static_assert(ChunkSize > 0);
+
+    polymorphic_event_queue() {}
+    polymorphic_event_queue(const polymorphic_event_queue&) = delete;
+    polymorphic_event_queue& operator=(const polymorphic_event_queue&) = delete;
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    // The time of the last dispatched event, or 0.
+    time_type now() const { return m_now; }
+
+    // The time of the next event, which must exist. Doesn't change now(), so earlier events can still be scheduled.
+    time_type next_time() const {
+        if (!m_buckets[0].empty())
+            return m_now;
+
+        // All keys of the first non-empty bucket are smaller than the keys of later buckets.
+        size_t i = 1;
+        while (m_buckets[i].empty())
+            i++;
+        time_type smallest = m_buckets[i].front().time;
+        for (const key& k : m_buckets[i])
+            smallest = min(smallest, k.time);
+        return smallest;
+    }
+
+    // Construct a U in a free slot and schedule it at time, which must not be before now().
+    template<typename U = T, typename... Args> void schedule(time_type time, Args&&... args) requires is_base_of_v<T, U> {
+        if (time < m_now)
+            throw invalid_argument("polymorphic_event_queue: time before now()");
+
+        uint32_t slot = allocate_slot();
+        try {
+            slot_at(slot).template emplace<U>(forward<Args>(args)...);
+            m_buckets[bucket_of(time)].push_back({ time, slot });
+        }
+        catch (...) {
+            // Destroys the event if the bucket couldn't grow, and doesn't throw as the slot was just taken from m_free.
+            release_slot(slot);
+            throw;
+        }
+        m_size++;
+    }
+
+    // Remove the earliest event, set now() to its time and call f(event) with the event in its slot. f may schedule more events.
+    // The event is destroyed afterwards, also if f throws. Returns false if the queue is empty.
+    template<typename F> bool dispatch(F&& f) {
+        if (m_size == 0)
+            return false;
+
+        refill();
+        key k = m_buckets[0].back();
+        m_buckets[0].pop_back();
+        m_size--;
+        m_now = k.time;
+        try {
+            f(*slot_at(k.slot));
+        }
+        catch (...) {
+            release_slot(k.slot);
+            throw;
+        }
+        release_slot(k.slot);
+        return true;
+    }
+
+    // Destroy all events. now() is kept, so later events can still not be scheduled before it.
+    void clear() {
+        for (vector<key>& b : m_buckets) {
+            for (const key& k : b)
+                release_slot(k.slot);
+            b.clear();
+        }
+        m_size = 0;
+    }
+
+private:
+    struct key {
+        time_type time;
+        uint32_t slot;
+    };
+
+    // Bucket 0 holds keys equal to m_now, bucket i keys whose highest bit differing from m_now is bit i - 1.
+    size_t bucket_of(time_type time) const { return time == m_now ? 0 : 64 - countl_zero(time ^ m_now); }
+
+    // Make bucket 0 non-empty by moving m_now to the smallest key, which is next_time(), and redistributing the first non-empty
+    // bucket, whose keys all go to lower buckets. Only called by dispatch when there are events, which then dispatches at m_now.
+    void refill() {
+        if (!m_buckets[0].empty())
+            return;
+
+        size_t i = 1;
+        while (m_buckets[i].empty())
+            i++;
+        vector<key>& b = m_buckets[i];
+        m_now = next_time();
+        for (const key& k : b)
+            m_buckets[bucket_of(k.time)].push_back(k);
+        b.clear();
+    }
+
+    value_type& slot_at(uint32_t slot) { return m_chunks[slot / ChunkSize][slot % ChunkSize]; }
+
+    uint32_t allocate_slot() {
+        if (m_free.empty()) {
+            if (m_chunks.size() * ChunkSize + ChunkSize > UINT32_MAX)
+                throw length_error("polymorphic_event_queue: too many events");
+            m_chunks.push_back(make_unique<value_type[]>(ChunkSize));
+            for (size_t i = ChunkSize; i > 0; i--)
+                m_free.push_back(uint32_t(m_chunks.size() * ChunkSize - ChunkSize + i - 1));
+        }
+        uint32_t ret = m_free.back();
+        m_free.pop_back();
+        return ret;
+    }
+    void release_slot(uint32_t slot) {
+        slot_at(slot).reset();
+        m_free.push_back(slot);
+    }
+
+    vector<key> m_buckets[65];
+    vector<unique_ptr<value_type[]>> m_chunks;
+    vector<uint32_t> m_free;            // Free slots, lowest index at the back so that slots are reused in order.
+    size_t m_size = 0;
+    time_type m_now = 0;
+};
+
+
+}       // Namespace std or stdx
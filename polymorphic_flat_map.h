@@ -0,0 +1,417 @@
+/*
+
+Open addressing hash map which stores polymorphic_values directly in its slots. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <cstdint>          // uint64_t, int8_t
+#include <bit>              // countr_zero
+#include <iterator>         // forward_iterator_tag
+#include <functional>       // hash, equal_to
+#include <stdexcept>        // out_of_range
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Hash map from K to polymorphic_value<V, Options> where each slot contains the key and the polymorphic_value itself, so an
+/// entry whose U fits the SBO buffer needs no allocation at all. Like SwissTable a separate array holds one control byte per slot,
+/// which is either empty, deleted or 7 bits of the hash of the key. Lookups test 8 control bytes at a time and only compare keys
+/// of slots whose control byte matches. When the table grows the values are moved using relocate_at, which is one virtual call.
+///
+/// Iterators and references are invalidated by rehashing, i.e. by inserting when the table is full and by reserve().
+template<typename K, typename V, polymorphic_value_options Options = polymorphic_value_options{}, typename Hash = hash<K>,
+         typename KeyEqual = equal_to<K>>
+class polymorphic_flat_map {
+public:
+    using key_type = K;
+    using mapped_type = polymorphic_value<V, Options>;
+    using size_type = size_t;
+
+    static_assert(is_move_constructible_v<mapped_type>, "The values must be movable to be able to rehash");
+
+private:
+    using ctrl_t = int8_t;
+    struct slot;
+
+public:
+    // Iterators dereference to a pair of references to the key and the value.
+    template<bool Const> class basic_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = pair<const K, mapped_type>;
+        using reference = pair<const K&, conditional_t<Const, const mapped_type&, mapped_type&>>;
+
+        struct pointer {
+            reference* operator->() { return &ref; }
+            reference ref;
+        };
+
+        basic_iterator() = default;
+        template<bool C = Const> requires C basic_iterator(const basic_iterator<false>& rhs) : m_ctrl(rhs.m_ctrl), m_end(rhs.m_end), m_slot(rhs.m_slot) {}
+
+        reference operator*() const { return { m_slot->key, m_slot->value }; }
+        pointer operator->() const { return { **this }; }
+
+        basic_iterator& operator++() {
+            ++m_ctrl;
+            ++m_slot;
+            skip_free();
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const basic_iterator& rhs) const { return m_ctrl == rhs.m_ctrl; }
+
+    private:
+        friend class polymorphic_flat_map;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(const ctrl_t* ctrl, const ctrl_t* end, slot* s) : m_ctrl(ctrl), m_end(end), m_slot(s) {}
+
+        void skip_free() {
+            while (m_ctrl != m_end && *m_ctrl < 0) {
+                ++m_ctrl;
+                ++m_slot;
+            }
+        }
+
+        const ctrl_t* m_ctrl = nullptr;
+        const ctrl_t* m_end = nullptr;
+        slot* m_slot = nullptr;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    polymorphic_flat_map() {}
+    polymorphic_flat_map(const polymorphic_flat_map& src) requires is_copy_constructible_v<K> && is_copy_constructible_v<mapped_type>
+        : m_hash(src.m_hash), m_equal(src.m_equal) {
+        if (src.m_size == 0)
+            return;
+
+        // Same capacity and hash functions, so each entry can be copied to the same slot.
+        try {
+            allocate(src.m_capacity);
+            for (size_t i = 0; i < m_capacity; i++) {
+                if (src.m_ctrl[i] >= 0) {
+                    construct_at(&m_slots[i], src.m_slots[i]);
+                    m_ctrl[i] = src.m_ctrl[i];
+                }
+            }
+        }
+        catch (...) {
+            // Only the slots whose entry was copied have a full control byte, so release destroys exactly those.
+            release();
+            throw;
+        }
+        m_size = src.m_size;
+        m_growth_left = src.m_growth_left;
+    }
+    polymorphic_flat_map(polymorphic_flat_map&& src) : m_hash(std::move(src.m_hash)), m_equal(std::move(src.m_equal)) { steal(src); }
+
+    ~polymorphic_flat_map() { release(); }
+
+    polymorphic_flat_map& operator=(const polymorphic_flat_map& src) requires is_copy_constructible_v<K> &&
+                                                                              is_copy_constructible_v<mapped_type> {
+        if (this != &src) {
+            polymorphic_flat_map copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_flat_map& operator=(polymorphic_flat_map&& src) {
+        if (this != &src) {
+            release();
+            m_hash = std::move(src.m_hash);
+            m_equal = std::move(src.m_equal);
+            steal(src);
+        }
+        return *this;
+    }
+
+    iterator begin() { return make_iterator(0, true); }
+    iterator end() { return make_iterator(m_capacity, false); }
+    const_iterator begin() const { return const_cast<polymorphic_flat_map*>(this)->begin(); }
+    const_iterator end() const { return const_cast<polymorphic_flat_map*>(this)->end(); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+
+    iterator find(const K& key) { return make_iterator(find_index(key, hash_of(key)), false); }
+    const_iterator find(const K& key) const { return const_cast<polymorphic_flat_map*>(this)->find(key); }
+    bool contains(const K& key) const { return find_index(key, hash_of(key)) != m_capacity; }
+
+    mapped_type& at(const K& key) {
+        size_t i = find_index(key, hash_of(key));
+        if (i == m_capacity)
+            throw out_of_range("polymorphic_flat_map::at");
+        return m_slots[i].value;
+    }
+    const mapped_type& at(const K& key) const { return const_cast<polymorphic_flat_map*>(this)->at(key); }
+
+    // Construct a U in place if key is not present. Returns the position of the key and whether a U was constructed.
+    template<typename U = V, typename... Args> pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        return emplace_impl<U>(key, forward<Args>(args)...);
+    }
+    template<typename U = V, typename... Args> pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return emplace_impl<U>(std::move(key), forward<Args>(args)...);
+    }
+
+    // Insert or replace the value of key with a U constructed in place.
+    template<typename U = V, typename... Args> pair<iterator, bool> insert_or_assign(const K& key, Args&&... args) {
+        auto ret = emplace_impl<U>(key, forward<Args>(args)...);
+        if (!ret.second)
+            ret.first->second.template emplace<U>(forward<Args>(args)...);
+        return ret;
+    }
+
+    size_t erase(const K& key) {
+        size_t i = find_index(key, hash_of(key));
+        if (i == m_capacity)
+            return 0;
+
+        erase_at(i);
+        return 1;
+    }
+    iterator erase(const_iterator pos) {
+        size_t i = pos.m_ctrl - m_ctrl;
+        erase_at(i);
+        return make_iterator(i, true);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < m_capacity; i++) {
+            if (m_ctrl[i] >= 0)
+                destroy_at(&m_slots[i]);
+            m_ctrl[i] = ctrl_empty;
+        }
+        m_size = 0;
+        m_growth_left = max_load(m_capacity);
+    }
+
+    // Make room for count entries without rehashing.
+    void reserve(size_t count) {
+        size_t capacity = group_width;
+        while (max_load(capacity) < count)
+            capacity *= 2;
+        if (capacity > m_capacity)
+            rehash(capacity);
+    }
+
+private:
+    struct slot {
+        K key;
+        mapped_type value;
+    };
+
+    // Control byte values. Full slots have the 7 lowest bits of the hash value, so the sign bit tells if a slot is free.
+    static constexpr ctrl_t ctrl_empty = -128;
+    static constexpr ctrl_t ctrl_deleted = -2;
+
+    // Slots are probed in aligned groups of 8, testing all control bytes of a group in parallel in an uint64_t.
+    static constexpr size_t group_width = 8;
+
+    struct group {
+        static constexpr uint64_t lsbs = 0x0101010101010101;
+        static constexpr uint64_t msbs = 0x8080808080808080;
+
+        explicit group(const ctrl_t* ctrl) {
+            for (size_t i = 0; i < group_width; i++)
+                m_bits |= uint64_t(uint8_t(ctrl[i])) << (8 * i);
+        }
+
+        // Each function returns a mask with the high bit of each matching byte set. match can give false positives for full
+        // slots next to a match, which is harmless as the keys are compared anyway.
+        uint64_t match(uint8_t h2) const {
+            uint64_t x = m_bits ^ (lsbs * h2);
+            return (x - lsbs) & ~x & msbs;
+        }
+        uint64_t match_empty() const { return m_bits & (~m_bits << 6) & msbs; }
+        uint64_t match_free() const { return m_bits & (~m_bits << 7) & msbs; }
+
+        static size_t first(uint64_t mask) { return countr_zero(mask) / 8; }
+
+        uint64_t m_bits = 0;
+    };
+
+    static constexpr size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+    size_t hash_of(const K& key) const {
+        uint64_t h = uint64_t(m_hash(key)) * 0x9E3779B97F4A7C15;   // Spread poor hashes such as the identity for integers.
+        return size_t(h ^ (h >> 32));
+    }
+    static uint8_t h2(size_t hash) { return hash & 0x7F; }
+
+    // Calls f with the index of the first slot of each group in the probe sequence of hash until f returns true.
+    template<typename F> void probe(size_t hash, F&& f) const {
+        size_t mask = m_capacity / group_width - 1;
+        size_t g = (hash >> 7) & mask;
+        for (size_t step = 1; !f(g * group_width); step++)
+            g = (g + step) & mask;      // Triangular numbers visit all groups as the group count is a power of 2.
+    }
+
+    size_t find_index(const K& key, size_t hash) const {
+        if (m_capacity == 0)
+            return 0;
+
+        size_t ret = m_capacity;
+        probe(hash, [&](size_t base) {
+            group g(m_ctrl + base);
+            for (uint64_t mask = g.match(h2(hash)); mask != 0; mask &= mask - 1) {
+                size_t i = base + group::first(mask);
+                if (m_equal(m_slots[i].key, key)) {
+                    ret = i;
+                    return true;
+                }
+            }
+            return g.match_empty() != 0;
+        });
+        return ret;
+    }
+
+    // First free slot in the probe sequence of hash. The table must not be full.
+    size_t find_free(size_t hash) const {
+        size_t ret = 0;
+        probe(hash, [&](size_t base) {
+            uint64_t mask = group(m_ctrl + base).match_free();
+            if (mask == 0)
+                return false;
+            ret = base + group::first(mask);
+            return true;
+        });
+        return ret;
+    }
+
+    template<typename U, typename KK, typename... Args> pair<iterator, bool> emplace_impl(KK&& key, Args&&... args) {
+        size_t hash = hash_of(key);
+        size_t i = find_index(key, hash);
+        if (i != m_capacity)
+            return { make_iterator(i, false), false };
+
+        if (m_growth_left == 0) {
+            // Rehash at the same size if at least half of the used slots are deleted.
+            rehash(m_capacity == 0 ? group_width : m_size < max_load(m_capacity) / 2 ? m_capacity : m_capacity * 2);
+        }
+
+        i = find_free(hash);
+        construct_at(&m_slots[i].key, forward<KK>(key));
+        try {
+            construct_at(&m_slots[i].value, in_place_type<U>, forward<Args>(args)...);
+        }
+        catch (...) {
+            destroy_at(&m_slots[i].key);
+            throw;
+        }
+
+        if (m_ctrl[i] == ctrl_empty)
+            m_growth_left--;
+        m_ctrl[i] = h2(hash);
+        m_size++;
+        return { make_iterator(i, false), true };
+    }
+
+    void erase_at(size_t i) {
+        destroy_at(&m_slots[i]);
+        m_size--;
+
+        // Probing stops at a group with an empty slot, so if this group already has one no probe sequence continues past it and
+        // the slot can be marked empty instead of deleted.
+        if (group(m_ctrl + i / group_width * group_width).match_empty() != 0) {
+            m_ctrl[i] = ctrl_empty;
+            m_growth_left++;
+        }
+        else
+            m_ctrl[i] = ctrl_deleted;
+    }
+
+    void rehash(size_t capacity) {
+        ctrl_t* old_ctrl = m_ctrl;
+        slot* old_slots = m_slots;
+        size_t old_capacity = m_capacity;
+
+        allocate(capacity);
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_ctrl[i] < 0)
+                continue;
+
+            slot& src = old_slots[i];
+            size_t hash = hash_of(src.key);
+            size_t j = find_free(hash);
+            slot& dest = m_slots[j];
+            construct_at(&dest.key, std::move(src.key));
+            destroy_at(&src.key);
+            relocate_at(&src.value, &dest.value);
+            m_ctrl[j] = h2(hash);
+        }
+        m_growth_left = max_load(m_capacity) - m_size;
+        deallocate(old_ctrl, old_slots, old_capacity);
+    }
+
+    void allocate(size_t capacity) {
+        m_ctrl = new ctrl_t[capacity];
+        fill_n(m_ctrl, capacity, ctrl_empty);
+        m_slots = allocator<slot>().allocate(capacity);
+        m_capacity = capacity;
+        m_growth_left = max_load(capacity);
+    }
+    static void deallocate(ctrl_t* ctrl, slot* slots, size_t capacity) {
+        delete[] ctrl;
+        if (slots != nullptr)
+            allocator<slot>().deallocate(slots, capacity);
+    }
+
+    void release() {
+        clear();
+        deallocate(m_ctrl, m_slots, m_capacity);
+        m_ctrl = nullptr;
+        m_slots = nullptr;
+        m_capacity = 0;
+        m_growth_left = 0;
+    }
+
+    void steal(polymorphic_flat_map& src) {
+        m_ctrl = exchange(src.m_ctrl, nullptr);
+        m_slots = exchange(src.m_slots, nullptr);
+        m_capacity = exchange(src.m_capacity, 0);
+        m_size = exchange(src.m_size, 0);
+        m_growth_left = exchange(src.m_growth_left, 0);
+    }
+
+    iterator make_iterator(size_t i, bool skip) {
+        iterator ret(m_ctrl + i, m_ctrl + m_capacity, m_slots + i);
+        if (skip)
+            ret.skip_free();
+        return ret;
+    }
+
+    ctrl_t* m_ctrl = nullptr;
+    slot* m_slots = nullptr;
+    size_t m_capacity = 0;          // 0 or a power of 2 which is at least group_width.
+    size_t m_size = 0;
+    size_t m_growth_left = 0;       // Number of empty slots which may be filled before rehashing.
+    [[no_unique_address]] Hash m_hash;
+    [[no_unique_address]] KeyEqual m_equal;
+};
+
+
+}       // Namespace std or stdx
@@ -0,0 +1,148 @@
+/*
+
+Coroutine generator which constructs each element in a polymorphic_value owned by the promise. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <coroutine>        // coroutine_handle, suspend_always
+#include <exception>        // exception_ptr, rethrow_exception
+#include <iterator>         // default_sentinel_t, input_iterator_tag
+#include <tuple>            // apply, forward_as_tuple
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// The operand of co_yield in a polymorphic_generator which constructs a U from args in the generator's slot. Returned by
+/// yield_emplace<U>(args...), it refers to the arguments, which live until the end of the co_yield expression.
+template<typename U, typename... Args> struct polymorphic_yield {
+    tuple<Args&&...> args;
+};
+
+template<typename U, typename... Args> polymorphic_yield<U, Args...> yield_emplace(Args&&... args) {
+    return { forward_as_tuple(forward<Args>(args)...) };
+}
+
+
+/// Generator coroutine return type whose elements are objects of subclasses of T. The promise owns a single polymorphic_value<T,
+/// Options> and `co_yield yield_emplace<U>(args...)` constructs each element in it, replacing the previous element, so a stream of
+/// elements which fit the SBO buffer is produced without allocating or moving elements. `co_yield object` with a T or subclass
+/// object copies or moves it into the slot.
+///
+/// The iterator returns a T& to the current element, which is valid until the iterator is incremented. current() returns the slot
+/// itself, for instance to call transform<U>. Exceptions thrown by the coroutine are rethrown by begin() and operator++.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_generator {
+public:
+    using value_type = polymorphic_value<T, Options>;
+
+    class promise_type {
+    public:
+        polymorphic_generator get_return_object() { return polymorphic_generator(handle::from_promise(*this)); }
+
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+
+        template<typename U, typename... Args> suspend_always yield_value(polymorphic_yield<U, Args...> y) requires is_base_of_v<T, U> {
+            apply([this](Args&&... args) { m_slot.template emplace<U>(forward<Args>(args)...); }, std::move(y.args));
+            return {};
+        }
+        template<typename U> suspend_always yield_value(U&& object) requires is_base_of_v<T, remove_cvref_t<U>> {
+            m_slot.template emplace<remove_cvref_t<U>>(forward<U>(object));
+            return {};
+        }
+
+        // Elements are produced synchronously, the generator can't co_await.
+        template<typename A> void await_transform(A&&) = delete;
+
+        void return_void() {}
+        void unhandled_exception() { m_exception = current_exception(); }
+
+    private:
+        friend class polymorphic_generator;
+
+        value_type m_slot;
+        exception_ptr m_exception;
+    };
+
+    class iterator {
+    public:
+        using iterator_category = input_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = T;
+        using reference = T&;
+        using pointer = T*;
+
+        iterator() = default;
+
+        reference operator*() const { return *m_generator->current(); }
+        pointer operator->() const { return m_generator->current().get(); }
+
+        iterator& operator++() {
+            m_generator->resume();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(default_sentinel_t) const { return m_generator->m_handle.done(); }
+
+    private:
+        friend class polymorphic_generator;
+
+        iterator(polymorphic_generator* generator) : m_generator(generator) {}
+
+        polymorphic_generator* m_generator = nullptr;
+    };
+
+    polymorphic_generator(polymorphic_generator&& src) : m_handle(exchange(src.m_handle, nullptr)) {}
+    ~polymorphic_generator() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    polymorphic_generator& operator=(polymorphic_generator&& src) {
+        if (this != &src) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = exchange(src.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    // Runs the coroutine to the first element, so begin() must only be called once.
+    iterator begin() {
+        resume();
+        return iterator(this);
+    }
+    default_sentinel_t end() { return default_sentinel; }
+
+    // The slot holding the current element.
+    value_type& current() { return m_handle.promise().m_slot; }
+
+private:
+    using handle = coroutine_handle<promise_type>;
+
+    explicit polymorphic_generator(handle h) : m_handle(h) {}
+
+    void resume() {
+        m_handle.resume();
+        promise_type& promise = m_handle.promise();
+        if (promise.m_exception)
+            rethrow_exception(exchange(promise.m_exception, nullptr));
+    }
+
+    handle m_handle;
+};
+
+
+}       // Namespace std or stdx
@@ -0,0 +1,139 @@
+/*
+
+Handlers for containers which store objects of different subclasses at their exact size. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <cstdint>          // uint32_t, uintptr_t
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// The operations of polymorphic_value's small_handler<U> for a U stored at an arbitrary address. Like the handlers of
+/// polymorphic_value this class has no data members, so a handler for a certain U is created by placement new and the vtable pointer
+/// is all that is stored with each object. The base class is not abstract, it is the handler of an empty element.
+template<typename T> struct polymorphic_handler {
+    virtual void imbue_handler(polymorphic_handler& dest) const { new(&dest) polymorphic_handler; }
+
+    virtual size_t size() const { return 0; }
+    virtual size_t alignment() const { return 1; }
+
+    virtual T* get(void* object) const { return nullptr; }
+
+    virtual void copy(void* dest, const void* src) const {}
+    virtual void move(void* dest, void* src) const {}
+    virtual void relocate(void* dest, void* src) const {}      // move followed by destroy of src.
+    virtual void destroy(void* object) const {}
+};
+
+template<typename T, typename U> struct polymorphic_handler_for final : public polymorphic_handler<T> {
+    void imbue_handler(polymorphic_handler<T>& dest) const override { new(&dest) polymorphic_handler_for; }
+
+    size_t size() const override { return sizeof(U); }
+    size_t alignment() const override { return alignof(U); }
+
+    T* get(void* object) const override { return static_cast<T*>(static_cast<U*>(object)); }
+
+    // The containers check that U is copyable or movable if they are, as polymorphic_value does.
+    void copy(void* dest, const void* src) const override {
+        if constexpr (is_copy_constructible_v<U>)
+            construct_at(static_cast<U*>(dest), *static_cast<const U*>(src));
+    }
+    void move(void* dest, void* src) const override {
+        if constexpr (is_move_constructible_v<U>)
+            construct_at(static_cast<U*>(dest), std::move(*static_cast<U*>(src)));
+    }
+    void relocate(void* dest, void* src) const override {
+        move(dest, src);
+        destroy(src);
+    }
+
+    void destroy(void* object) const override { destroy_at(static_cast<U*>(object)); }
+};
+
+
+/// Header placed in front of each object by containers which pack objects of different sizes back to back. It holds the handler and
+/// the offsets of the object and of the end of the object, which lets containers step to the next element without a virtual call.
+/// The object is placed at the first suitably aligned address after the header.
+template<typename T> class polymorphic_element {
+public:
+    polymorphic_element(const polymorphic_element&) = delete;
+    polymorphic_element& operator=(const polymorphic_element&) = delete;
+
+    // Number of bytes from where to the end of an object of the given size and alignment, if an element is constructed at where.
+    static size_t extent_at(const void* where, size_t size, size_t alignment) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(where);
+        uintptr_t object = (start + sizeof(polymorphic_element) + alignment - 1) & ~(alignment - 1);
+        return object - start + size;
+    }
+    template<typename U> static size_t extent_at(const void* where) { return extent_at(where, sizeof(U), alignof(U)); }
+
+    // Construct an element holding a U at where, which must be aligned for polymorphic_element and have room for extent_at<U>(where)
+    // bytes.
+    template<typename U, typename... Args> static polymorphic_element* construct_at(void* where, Args&&... args) {
+        polymorphic_element* ret = new(where) polymorphic_element(where, sizeof(U), alignof(U));
+        STD::construct_at(static_cast<U*>(ret->object()), forward<Args>(args)...);
+        new(&ret->m_handler) polymorphic_handler_for<T, U>;
+        return ret;
+    }
+
+    // Copy or relocate this element to where, which must have room for extent_at(where, size(), alignment()) bytes.
+    polymorphic_element* copy_to(void* where) const {
+        const polymorphic_handler<T>& h = handler();
+        polymorphic_element* ret = new(where) polymorphic_element(where, h.size(), h.alignment());
+        h.copy(ret->object(), object());
+        h.imbue_handler(ret->m_handler);
+        return ret;
+    }
+    polymorphic_element* relocate_to(void* where) {
+        const polymorphic_handler<T>& h = handler();
+        polymorphic_element* ret = new(where) polymorphic_element(where, h.size(), h.alignment());
+        h.relocate(ret->object(), object());
+        h.imbue_handler(ret->m_handler);
+        new(&m_handler) polymorphic_handler<T>;
+        return ret;
+    }
+
+    // Destroy the object, after which the element is empty.
+    void destroy() {
+        handler().destroy(object());
+        new(&m_handler) polymorphic_handler<T>;
+    }
+
+    T* get() { return handler().get(object()); }
+    const T* get() const { return const_cast<polymorphic_element*>(this)->get(); }
+
+    size_t size() const { return handler().size(); }
+    size_t alignment() const { return handler().alignment(); }
+
+    // Bytes from the start of the element to the end of the object.
+    size_t extent() const { return m_extent; }
+
+    void* object() { return reinterpret_cast<byte*>(this) + m_object_offset; }
+    const void* object() const { return reinterpret_cast<const byte*>(this) + m_object_offset; }
+
+    const polymorphic_handler<T>& handler() const { return *std::launder(&m_handler); }
+
+private:
+    polymorphic_element(const void* where, size_t size, size_t alignment)
+        : m_extent(uint32_t(extent_at(where, size, alignment))) { m_object_offset = uint32_t(m_extent - size); }
+
+    polymorphic_handler<T> m_handler;
+    uint32_t m_object_offset;
+    uint32_t m_extent;
+};
+
+
+}       // Namespace std or stdx
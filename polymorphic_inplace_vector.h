@@ -0,0 +1,215 @@
+/*
+
+Fixed capacity container of objects of different subclasses packed in an inline buffer. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_handler.h"
+
+#include <iterator>         // forward_iterator_tag
+#include <new>              // bad_alloc
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Container of objects of subclasses of T packed back to back in a buffer of Capacity bytes inside the container itself, so it never
+/// allocates. Each object is stored at its own size in a polymorphic_element, preceded by the offset of the previous element to make
+/// pop_back O(1). try_emplace_back returns nullptr when the object does not fit, emplace_back throws bad_alloc.
+///
+/// With the copy option the vector can be copied, which copies each element to the same offset in the new buffer. As the objects
+/// are inside the vector, moving it relocates each object into the new buffer and leaves the source empty, so the move option is
+/// needed to move the vector. The buffer is aligned for the largest of alignof(T) and the alignment option, and a U with a larger
+/// alignment is a compile time error.
+template<typename T, size_t Capacity, polymorphic_value_options Options = polymorphic_value_options{}>
+class polymorphic_inplace_vector {
+    using element = polymorphic_element<T>;
+
+    static const size_t alignment = max({ alignof(T), Options.alignment, alignof(element) });
+    static const bool copyable = Options.copy && is_copy_constructible_v<T>;
+    static const bool movable = Options.move && is_move_constructible_v<T>;
+
+    static_assert(Capacity < UINT32_MAX, "Offsets are stored in 32 bits");
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+
+    template<bool Const> class basic_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = T;
+        using reference = conditional_t<Const, const T&, T&>;
+        using pointer = conditional_t<Const, const T*, T*>;
+        using vector_pointer = conditional_t<Const, const polymorphic_inplace_vector*, polymorphic_inplace_vector*>;
+
+        basic_iterator() = default;
+        template<bool C = Const> requires C basic_iterator(const basic_iterator<false>& rhs) : m_vector(rhs.m_vector), m_pos(rhs.m_pos) {}
+
+        reference operator*() const { return *m_vector->element_at(m_pos)->get(); }
+        pointer operator->() const { return m_vector->element_at(m_pos)->get(); }
+
+        basic_iterator& operator++() { m_pos = m_vector->next(m_pos); return *this; }
+        basic_iterator operator++(int) {
+            basic_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const basic_iterator& rhs) const { return m_pos == rhs.m_pos; }
+
+    private:
+        friend class polymorphic_inplace_vector;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(vector_pointer v, size_t pos) : m_vector(v), m_pos(pos) {}
+
+        vector_pointer m_vector = nullptr;
+        size_t m_pos = 0;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    polymorphic_inplace_vector() {}
+
+    // As the buffers have the same alignment each element can be put at the same offset, giving the same layout.
+    polymorphic_inplace_vector(const polymorphic_inplace_vector& src) requires copyable {
+        try {
+            for (size_t pos = 0; pos != src.m_end; pos = src.next(pos)) {
+                src.element_at(pos)->copy_to(m_buffer + pos + link_size);
+                link_at(pos) = src.link_at(pos);
+                m_end = src.next(pos);
+                m_back = uint32_t(pos);
+                m_size++;
+            }
+        }
+        catch (...) {
+            // Destroy the elements copied so far, which m_end covers.
+            clear();
+            throw;
+        }
+    }
+    polymorphic_inplace_vector(polymorphic_inplace_vector&& src) requires movable { steal(src); }
+
+    ~polymorphic_inplace_vector() { clear(); }
+
+    polymorphic_inplace_vector& operator=(const polymorphic_inplace_vector& src) requires copyable {
+        if (this != &src) {
+            polymorphic_inplace_vector copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_inplace_vector& operator=(polymorphic_inplace_vector&& src) requires movable {
+        if (this != &src) {
+            clear();
+            steal(src);
+        }
+        return *this;
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_end); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_end); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Number of bytes used, including element headers and padding.
+    size_t bytes_used() const { return m_end; }
+
+    T& front() { return *begin(); }
+    const T& front() const { return *begin(); }
+    T& back() { return *element_at(m_back)->get(); }
+    const T& back() const { return *element_at(m_back)->get(); }
+
+    // Construct a U after the last element if it fits, otherwise return nullptr.
+    template<typename U = T, typename... Args> U* try_emplace_back(Args&&... args) requires is_base_of_v<T, U> {
+        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
+        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the move option must be set to false");
+        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
+
+        size_t pos = m_end;
+        byte* where = m_buffer + pos + link_size;
+        if (pos + link_size + element::template extent_at<U>(where) > Capacity)
+            return nullptr;
+
+        element* e = element::template construct_at<U>(where, forward<Args>(args)...);
+        link_at(pos) = m_size == 0 ? no_element : m_back;
+        m_back = uint32_t(pos);
+        m_end = next(pos);
+        m_size++;
+        return static_cast<U*>(e->object());
+    }
+    template<typename U = T, typename... Args> U& emplace_back(Args&&... args) requires is_base_of_v<T, U> {
+        U* ret = try_emplace_back<U>(forward<Args>(args)...);
+        if (ret == nullptr)
+            throw bad_alloc();
+        return *ret;
+    }
+    template<typename U> void push_back(U&& object) requires is_base_of_v<T, remove_cvref_t<U>> {
+        emplace_back<remove_cvref_t<U>>(forward<U>(object));
+    }
+
+    void pop_back() {
+        element_at(m_back)->destroy();
+        m_end = m_back;
+        m_back = link_at(m_back);
+        m_size--;
+    }
+
+    void clear() {
+        for (size_t pos = 0; pos != m_end; pos = next(pos))
+            element_at(pos)->destroy();
+        m_end = 0;
+        m_back = no_element;
+        m_size = 0;
+    }
+
+private:
+    // Each entry starts with the offset of the previous entry, followed by the element.
+    static constexpr size_t link_size = alignof(element);
+    static constexpr uint32_t no_element = ~uint32_t(0);
+
+    uint32_t& link_at(size_t pos) { return *reinterpret_cast<uint32_t*>(m_buffer + pos); }
+    const uint32_t& link_at(size_t pos) const { return *reinterpret_cast<const uint32_t*>(m_buffer + pos); }
+
+    element* element_at(size_t pos) { return std::launder(reinterpret_cast<element*>(m_buffer + pos + link_size)); }
+    const element* element_at(size_t pos) const { return const_cast<polymorphic_inplace_vector*>(this)->element_at(pos); }
+
+    // Offset of the entry after the one at pos, rounded up so that the next link and element are aligned.
+    size_t next(size_t pos) const { return (pos + link_size + element_at(pos)->extent() + link_size - 1) & ~(link_size - 1); }
+
+    void steal(polymorphic_inplace_vector& src) {
+        for (size_t pos = 0; pos != src.m_end; pos = src.next(pos)) {
+            src.element_at(pos)->relocate_to(m_buffer + pos + link_size);
+            link_at(pos) = src.link_at(pos);
+        }
+        m_end = exchange(src.m_end, 0);
+        m_back = exchange(src.m_back, no_element);
+        m_size = exchange(src.m_size, 0);
+    }
+
+    alignas(alignment) byte m_buffer[Capacity];
+    uint32_t m_end = 0;                 // Offset after the last entry.
+    uint32_t m_back = no_element;       // Offset of the last entry.
+    size_t m_size = 0;
+};
+
+
+}       // Namespace std or stdx
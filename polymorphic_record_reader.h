@@ -0,0 +1,146 @@
+/*
+
+Streaming reader which decodes serialized records into reused polymorphic_values. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_type_registry.h"
+
+#include <cstdint>          // uint32_t
+#include <cstring>          // memcpy, memmove
+#include <istream>
+#include <span>
+#include <stdexcept>        // invalid_argument
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Reads a stream of records, each a 32 bit type id and a 32 bit byte count in native byte order followed by that many bytes, and
+/// decodes them with a polymorphic_type_registry into polymorphic_values owned by the caller. As the caller reuses the same values
+/// for each record, records of types which fit the SBO buffer are decoded without allocating. append() writes the format.
+///
+/// The records are read from a span, such as a memory mapped file, or from an istream through a buffer which is refilled as needed
+/// and grows to hold the largest record. Reading into a span of values decodes a batch of records per call. A truncated record or
+/// an unknown type id throws invalid_argument.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_record_reader {
+public:
+    using registry_type = polymorphic_type_registry<T, Options>;
+    using value_type = typename registry_type::value_type;
+
+    static constexpr size_t header_size = 2 * sizeof(uint32_t);
+
+    polymorphic_record_reader(const registry_type& registry, span<const byte> records) : m_registry(registry), m_data(records) {}
+    polymorphic_record_reader(const registry_type& registry, istream& stream, size_t buffer_size = size_t(1) << 20)
+        : m_registry(registry), m_stream(&stream), m_buffer(max(buffer_size, header_size)) {}
+
+    polymorphic_record_reader(const polymorphic_record_reader&) = delete;
+    polymorphic_record_reader& operator=(const polymorphic_record_reader&) = delete;
+
+    // Decode the next record into dest. Returns false at the end of the records, leaving dest unchanged.
+    bool read(value_type& dest) {
+        uint32_t id;
+        span<const byte> bytes;
+        if (!next(id, bytes))
+            return false;
+        decode(id, bytes, dest);
+        return true;
+    }
+
+    // Decode records into the values of dest until it is full or the records end, and return the number of records decoded.
+    size_t read(span<value_type> dest) {
+        size_t count = 0;
+        uint32_t id;
+        span<const byte> bytes;
+        while (count < dest.size() && next(id, bytes))
+            decode(id, bytes, dest[count++]);
+        return count;
+    }
+
+    // Number of bytes of the records read so far, including headers.
+    size_t bytes_read() const { return m_bytes_read; }
+
+    // Append a record to out.
+    static void append(vector<byte>& out, uint32_t id, span<const byte> bytes) {
+        uint32_t header[2] = { id, uint32_t(bytes.size()) };
+        size_t pos = out.size();
+        out.resize(pos + header_size + bytes.size());
+        memcpy(out.data() + pos, header, header_size);
+        if (!bytes.empty())
+            memcpy(out.data() + pos + header_size, bytes.data(), bytes.size());
+    }
+
+private:
+    // Split off the next record from m_data, refilling it from the stream if it does not hold the whole record.
+    bool next(uint32_t& id, span<const byte>& bytes) {
+        if (m_data.size() < header_size && !fill(header_size))
+            return false;
+
+        uint32_t header[2];
+        memcpy(header, m_data.data(), header_size);
+        size_t size = header_size + header[1];
+        if (m_data.size() < size && !fill(size))
+            throw invalid_argument("polymorphic_record_reader: truncated record");
+
+        id = header[0];
+        bytes = m_data.subspan(header_size, header[1]);
+        m_data = m_data.subspan(size);
+        m_bytes_read += size;
+        return true;
+    }
+
+    // Make m_data hold at least size bytes by moving the rest of it to the start of the buffer and reading from the stream. Returns
+    // false if the records end before that, which is an error unless m_data is empty.
+    bool fill(size_t size) {
+        if (m_stream != nullptr) {
+            size_t kept = m_data.size();
+            if (kept > 0 && m_data.data() != m_buffer.data())
+                memmove(m_buffer.data(), m_data.data(), kept);
+            if (m_buffer.size() < size)
+                m_buffer.resize(size);
+            while (kept < size && *m_stream) {
+                m_stream->read(reinterpret_cast<char*>(m_buffer.data() + kept), streamsize(m_buffer.size() - kept));
+                kept += size_t(m_stream->gcount());
+            }
+            m_data = span<const byte>(m_buffer.data(), kept);
+        }
+
+        if (m_data.size() >= size)
+            return true;
+        if (!m_data.empty())
+            throw invalid_argument("polymorphic_record_reader: truncated record");
+        return false;
+    }
+
+    // Records of the same type often follow each other, so the last decoder is kept to skip the registry lookup.
+    void decode(uint32_t id, span<const byte> bytes, value_type& dest) {
+        if (id != m_last_id || m_last_decoder == nullptr) {
+            m_last_decoder = m_registry.find(id);
+            if (m_last_decoder == nullptr)
+                throw invalid_argument("polymorphic_record_reader: unknown type id");
+            m_last_id = id;
+        }
+        m_last_decoder(dest, bytes);
+    }
+
+    const registry_type& m_registry;
+    istream* m_stream = nullptr;
+    vector<byte> m_buffer;                  // Only used with a stream.
+    span<const byte> m_data;                // The records not read yet, or with a stream the part of them in m_buffer.
+    size_t m_bytes_read = 0;
+    uint32_t m_last_id = 0;
+    typename registry_type::decoder m_last_decoder = nullptr;
+};
+
+
+}       // Namespace std or stdx
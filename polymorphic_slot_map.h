@@ -0,0 +1,325 @@
+/*
+
+Slot map of polymorphic_values with generation checked handles. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <cstdint>          // uint32_t
+#include <iterator>         // random_access_iterator_tag
+#include <stdexcept>        // out_of_range, length_error
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Container of polymorphic_value<T, Options> objects which are referred to by 32 bit handles. A handle contains a 24 bit slot index
+/// and the 8 bit generation of the slot, which is incremented each time the object in the slot is erased, so a handle to an erased
+/// object never finds a new object in the same slot. Free slots are reused in FIFO order, and a slot whose generation would wrap
+/// around is retired instead of reused, so a slot can be reused 255 times. At most 2^24 - 1 slots are used in total.
+///
+/// The values are kept densely packed in chunks of ChunkSize objects so iteration only visits live objects. Chunks are never
+/// moved or freed when the map grows, so pointers to values stay valid until the value or the last value is erased: erase
+/// relocates the last value into the hole using relocate_at, keeping insert and erase O(1).
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}, size_t ChunkSize = 64>
+class polymorphic_slot_map {
+public:
+    using value_type = polymorphic_value<T, Options>;
+    using size_type = size_t;
+
+    static_assert(is_move_constructible_v<value_type>, "The values must be movable to be able to erase");
+    static_assert(ChunkSize > 0);
+
+    // The 24 lowest bits of a handle are the slot index, the 8 highest bits the generation of the slot.
+    class handle {
+    public:
+        static constexpr uint32_t index_bits = 24;
+        static constexpr uint32_t index_mask = (1u << index_bits) - 1;
+
+        handle() = default;
+        explicit handle(uint32_t bits) : m_bits(bits) {}
+
+        uint32_t bits() const { return m_bits; }
+        uint32_t index() const { return m_bits & index_mask; }
+        uint32_t generation() const { return m_bits >> index_bits; }
+
+        explicit operator bool() const { return m_bits != ~uint32_t(0); }
+        bool operator==(const handle&) const = default;
+
+    private:
+        friend class polymorphic_slot_map;
+
+        handle(uint32_t index, uint32_t generation) : m_bits(generation << index_bits | index) {}
+
+        uint32_t m_bits = ~uint32_t(0);     // The null handle, whose index is never used by a slot.
+    };
+
+    static constexpr size_t max_size() { return handle::index_mask; }
+
+    template<bool Const> class basic_iterator {
+    public:
+        using iterator_category = random_access_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = polymorphic_slot_map::value_type;
+        using reference = conditional_t<Const, const value_type&, value_type&>;
+        using pointer = conditional_t<Const, const value_type*, value_type*>;
+        using map_pointer = conditional_t<Const, const polymorphic_slot_map*, polymorphic_slot_map*>;
+
+        basic_iterator() = default;
+        template<bool C = Const> requires C basic_iterator(const basic_iterator<false>& rhs) : m_map(rhs.m_map), m_pos(rhs.m_pos) {}
+
+        reference operator*() const { return m_map->value_at(m_pos); }
+        pointer operator->() const { return &m_map->value_at(m_pos); }
+        reference operator[](difference_type n) const { return m_map->value_at(m_pos + n); }
+
+        // The handle of the current value.
+        handle get_handle() const { return m_map->handle_at(m_pos); }
+
+        basic_iterator& operator++() { ++m_pos; return *this; }
+        basic_iterator& operator--() { --m_pos; return *this; }
+        basic_iterator operator++(int) { return basic_iterator(m_map, m_pos++); }
+        basic_iterator operator--(int) { return basic_iterator(m_map, m_pos--); }
+        basic_iterator& operator+=(difference_type n) { m_pos += n; return *this; }
+        basic_iterator& operator-=(difference_type n) { m_pos -= n; return *this; }
+        basic_iterator operator+(difference_type n) const { return basic_iterator(m_map, m_pos + n); }
+        basic_iterator operator-(difference_type n) const { return basic_iterator(m_map, m_pos - n); }
+        friend basic_iterator operator+(difference_type n, const basic_iterator& it) { return it + n; }
+        difference_type operator-(const basic_iterator& rhs) const { return difference_type(m_pos) - difference_type(rhs.m_pos); }
+
+        bool operator==(const basic_iterator& rhs) const { return m_pos == rhs.m_pos; }
+        auto operator<=>(const basic_iterator& rhs) const { return m_pos <=> rhs.m_pos; }
+
+    private:
+        friend class polymorphic_slot_map;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(map_pointer map, size_t pos) : m_map(map), m_pos(pos) {}
+
+        map_pointer m_map = nullptr;
+        size_t m_pos = 0;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    polymorphic_slot_map() {}
+    polymorphic_slot_map(const polymorphic_slot_map& src) requires is_copy_constructible_v<value_type>
+        : m_slots(src.m_slots), m_dense_slots(src.m_dense_slots), m_free_head(src.m_free_head), m_free_tail(src.m_free_tail) {
+        reserve(src.m_size);
+        try {
+            for (; m_size < src.m_size; m_size++)
+                construct_at(&value_at(m_size), src.value_at(m_size));
+        }
+        catch (...) {
+            // Destroy the values copied so far. The members free the chunks and slot vectors.
+            clear();
+            throw;
+        }
+    }
+    polymorphic_slot_map(polymorphic_slot_map&& src)
+        : m_chunks(std::move(src.m_chunks)), m_slots(std::move(src.m_slots)), m_dense_slots(std::move(src.m_dense_slots)),
+          m_size(exchange(src.m_size, 0)), m_free_head(exchange(src.m_free_head, no_slot)),
+          m_free_tail(exchange(src.m_free_tail, no_slot)) {}
+
+    ~polymorphic_slot_map() { clear(); }
+
+    polymorphic_slot_map& operator=(const polymorphic_slot_map& src) requires is_copy_constructible_v<value_type> {
+        if (this != &src) {
+            polymorphic_slot_map copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_slot_map& operator=(polymorphic_slot_map&& src) {
+        if (this != &src) {
+            clear();
+            m_chunks = std::move(src.m_chunks);
+            m_slots = std::move(src.m_slots);
+            m_dense_slots = std::move(src.m_dense_slots);
+            m_size = exchange(src.m_size, 0);
+            m_free_head = exchange(src.m_free_head, no_slot);
+            m_free_tail = exchange(src.m_free_tail, no_slot);
+        }
+        return *this;
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_size); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_size); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_chunks.size() * ChunkSize; }
+
+    // Construct a U in a new slot and return its handle.
+    template<typename U = T, typename... Args> handle emplace(Args&&... args) {
+        size_t slot_count = m_slots.size();
+        uint32_t index = m_free_head == no_slot ? uint32_t(slot_count) : m_free_head;
+        if (index == handle::index_mask)
+            throw length_error("polymorphic_slot_map::emplace");
+        reserve(m_size + 1);
+
+        try {
+            if (index == slot_count)
+                m_slots.push_back({});
+            m_dense_slots.push_back(index);
+            construct_at(&value_at(m_size), in_place_type<U>, forward<Args>(args)...);
+        }
+        catch (...) {
+            // Undo the push_backs which were done before a push_back or the constructor threw.
+            m_slots.resize(slot_count);
+            m_dense_slots.resize(m_size);
+            throw;
+        }
+
+        if (index == m_free_head) {
+            m_free_head = m_slots[index].position;
+            if (m_free_head == no_slot)
+                m_free_tail = no_slot;
+        }
+        m_slots[index].position = uint32_t(m_size);
+        m_size++;
+        return handle(index, m_slots[index].generation);
+    }
+
+    // Destroy the value of h. Returns false if h does not refer to a live value.
+    bool erase(handle h) {
+        uint32_t pos = position_of(h);
+        if (pos == no_slot)
+            return false;
+
+        erase_at(pos);
+        return true;
+    }
+    iterator erase(const_iterator pos) {
+        erase_at(pos.m_pos);
+        return iterator(this, pos.m_pos);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < m_size; i++) {
+            destroy_at(&value_at(i));
+            free_slot(m_dense_slots[i]);
+        }
+        m_dense_slots.clear();
+        m_size = 0;
+    }
+
+    // Make room for count values, allocating chunks as needed.
+    void reserve(size_t count) {
+        while (capacity() < count)
+            m_chunks.push_back(make_unique<chunk>());
+    }
+
+    bool contains(handle h) const { return position_of(h) != no_slot; }
+
+    // Returns nullptr if h does not refer to a live value.
+    value_type* find(handle h) {
+        uint32_t pos = position_of(h);
+        return pos == no_slot ? nullptr : &value_at(pos);
+    }
+    const value_type* find(handle h) const { return const_cast<polymorphic_slot_map*>(this)->find(h); }
+
+    value_type& at(handle h) {
+        value_type* ret = find(h);
+        if (ret == nullptr)
+            throw out_of_range("polymorphic_slot_map::at");
+        return *ret;
+    }
+    const value_type& at(handle h) const { return const_cast<polymorphic_slot_map*>(this)->at(h); }
+
+    // Unchecked access for handles known to be live.
+    value_type& operator[](handle h) { return value_at(m_slots[h.index()].position); }
+    const value_type& operator[](handle h) const { return value_at(m_slots[h.index()].position); }
+
+private:
+    static constexpr uint32_t no_slot = ~uint32_t(0);
+    static constexpr uint32_t max_generation = ~uint32_t(0) >> handle::index_bits;
+
+    // For a live slot position is the index of the value in the dense storage, for a free slot the index of the next free slot.
+    struct slot {
+        uint32_t position = no_slot;
+        uint32_t generation = 0;
+    };
+
+    struct chunk {
+        alignas(value_type) byte storage[sizeof(value_type) * ChunkSize];
+    };
+
+    value_type& value_at(size_t pos) {
+        return reinterpret_cast<value_type*>(m_chunks[pos / ChunkSize]->storage)[pos % ChunkSize];
+    }
+    const value_type& value_at(size_t pos) const { return const_cast<polymorphic_slot_map*>(this)->value_at(pos); }
+
+    handle handle_at(size_t pos) const {
+        uint32_t index = m_dense_slots[pos];
+        return handle(index, m_slots[index].generation);
+    }
+
+    uint32_t position_of(handle h) const {
+        uint32_t index = h.index();
+        if (index >= m_slots.size())
+            return no_slot;
+
+        const slot& s = m_slots[index];
+        if (s.generation != h.generation() || s.position >= m_size || m_dense_slots[s.position] != index)
+            return no_slot;
+
+        return s.position;
+    }
+
+    void erase_at(size_t pos) {
+        destroy_at(&value_at(pos));
+        free_slot(m_dense_slots[pos]);
+
+        // Fill the hole with the last value.
+        size_t last = m_size - 1;
+        if (pos != last) {
+            relocate_at(&value_at(last), &value_at(pos));
+            m_dense_slots[pos] = m_dense_slots[last];
+            m_slots[m_dense_slots[pos]].position = uint32_t(pos);
+        }
+        m_dense_slots.pop_back();
+        m_size--;
+    }
+
+    // Append the slot to the free list. FIFO order spreads the generation increments over all free slots. A slot at the last
+    // generation is retired by not putting it on the free list, so its generation never wraps around to one of an old handle.
+    void free_slot(uint32_t index) {
+        slot& s = m_slots[index];
+        s.position = no_slot;
+        if (s.generation == max_generation)
+            return;
+
+        s.generation++;
+        if (m_free_tail == no_slot)
+            m_free_head = index;
+        else
+            m_slots[m_free_tail].position = index;
+        m_free_tail = index;
+    }
+
+    vector<unique_ptr<chunk>> m_chunks;
+    vector<slot> m_slots;
+    vector<uint32_t> m_dense_slots;     // Slot index of each value in the dense storage.
+    size_t m_size = 0;
+    uint32_t m_free_head = no_slot;      // Free slots are linked through position from head to tail.
+    uint32_t m_free_tail = no_slot;
+};
+
+
+}       // Namespace std or stdx
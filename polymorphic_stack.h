@@ -0,0 +1,283 @@
+/*
+
+LIFO stack of objects of different subclasses, bump allocated in chunks. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_handler.h"
+
+#include <iterator>         // forward_iterator_tag
+#include <new>              // align_val_t
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Stack of objects of subclasses of T where each object is stored at its own size in a polymorphic_element, bump allocated in chunks
+/// of ChunkSize bytes. push and pop only move the top pointer, apart from the virtual call to construct or destroy the object, and
+/// objects are never moved. Each element is preceded by a pointer to the element below it. Chunks are kept when the stack shrinks so
+/// that a stack oscillating around a chunk boundary does not allocate, shrink_to_fit frees them.
+///
+/// Iteration goes from the top of the stack downwards. With the copy option the stack can be copied, the copy is built from the
+/// bottom up so its frames are packed into as few chunks as possible. Frames stay where they were constructed also when the stack is
+/// moved, so the move option only requires each U to be movable. A U whose alignment exceeds both alignof(T) and the alignment
+/// option does not compile.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}, size_t ChunkSize = 16384>
+class polymorphic_stack {
+    using element = polymorphic_element<T>;
+
+    static const size_t alignment = max({ alignof(T), Options.alignment, alignof(element) });
+    static const bool copyable = Options.copy && is_copy_constructible_v<T>;
+    static const bool movable = Options.move && is_move_constructible_v<T>;
+
+    struct chunk;
+
+    static_assert(ChunkSize % alignof(element) == 0, "ChunkSize must be a multiple of the alignment of polymorphic_element");
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+
+    template<bool Const> class basic_iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = T;
+        using reference = conditional_t<Const, const T&, T&>;
+        using pointer = conditional_t<Const, const T*, T*>;
+
+        basic_iterator() = default;
+        template<bool C = Const> requires C basic_iterator(const basic_iterator<false>& rhs) : m_entry(rhs.m_entry) {}
+
+        reference operator*() const { return *element_at(m_entry)->get(); }
+        pointer operator->() const { return element_at(m_entry)->get(); }
+
+        basic_iterator& operator++() { m_entry = below(m_entry); return *this; }
+        basic_iterator operator++(int) {
+            basic_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        bool operator==(const basic_iterator& rhs) const { return m_entry == rhs.m_entry; }
+
+    private:
+        friend class polymorphic_stack;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(byte* e) : m_entry(e) {}
+
+        byte* m_entry = nullptr;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    polymorphic_stack() {}
+    polymorphic_stack(const polymorphic_stack& src) requires copyable {
+        vector<const element*> elements;     // Top to bottom, copied in reverse.
+        elements.reserve(src.m_size);
+        for (byte* e = src.m_top; e != nullptr; e = below(e))
+            elements.push_back(element_at(e));
+        try {
+            for (auto i = elements.rbegin(); i != elements.rend(); ++i) {
+                byte* where = place((*i)->size(), (*i)->alignment());
+                (*i)->copy_to(where + link_size);
+                commit(where);
+            }
+        }
+        catch (...) {
+            // Destroy the frames copied so far, which are linked from m_top, and free all chunks.
+            release();
+            throw;
+        }
+    }
+    polymorphic_stack(polymorphic_stack&& src) { steal(src); }
+
+    ~polymorphic_stack() { release(); }
+
+    polymorphic_stack& operator=(const polymorphic_stack& src) requires copyable {
+        if (this != &src) {
+            polymorphic_stack copy(src);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    polymorphic_stack& operator=(polymorphic_stack&& src) {
+        if (this != &src) {
+            release();
+            steal(src);
+        }
+        return *this;
+    }
+
+    iterator begin() { return iterator(m_top); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(m_top); }
+    const_iterator end() const { return const_iterator(); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    T& top() { return *element_at(m_top)->get(); }
+    const T& top() const { return *element_at(m_top)->get(); }
+
+    // Construct a U on top of the stack.
+    template<typename U = T, typename... Args> U& emplace(Args&&... args) requires is_base_of_v<T, U> {
+        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
+        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the move option must be set to false");
+        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
+
+        byte* where = place(sizeof(U), alignof(U));
+        element* e = element::template construct_at<U>(where + link_size, forward<Args>(args)...);
+        commit(where);
+        return *static_cast<U*>(e->object());
+    }
+    template<typename U> void push(U&& object) requires is_base_of_v<T, remove_cvref_t<U>> {
+        emplace<remove_cvref_t<U>>(forward<U>(object));
+    }
+
+    void pop() {
+        byte* e = m_top;
+        element_at(e)->destroy();
+        m_top = below(e);
+        m_size--;
+
+        // The popped entry is where the next push goes. If it was first in its chunk the top is in an earlier chunk.
+        m_free = e;
+        if (m_top == nullptr)
+            reset();
+        else if (m_free == m_current->begin()) {
+            do
+                m_current = m_current->m_previous;
+            while (!m_current->contains(m_top));
+            m_free = end_of(m_top);
+        }
+    }
+
+    void clear() {
+        while (m_top != nullptr) {
+            element_at(m_top)->destroy();
+            m_top = below(m_top);
+        }
+        m_size = 0;
+        reset();
+    }
+
+    // Free the chunks above the one in use.
+    void shrink_to_fit() {
+        if (m_current != nullptr) {
+            free_chunks(m_current->m_next);
+            m_current->m_next = nullptr;
+        }
+    }
+
+private:
+    // Chunks form a doubly linked list from the bottom of the stack. The stack grows from begin() towards m_limit.
+    struct chunk {
+        chunk(chunk* previous, size_t capacity) : m_previous(previous), m_limit(begin() + capacity) {}
+
+        byte* begin() { return reinterpret_cast<byte*>(this) + header_size; }
+        bool fits(byte* end) const { return end <= m_limit; }
+        bool contains(byte* pos) { return begin() <= pos && pos < m_limit; }
+
+        chunk* m_previous;
+        chunk* m_next = nullptr;
+        byte* m_limit;
+    };
+
+    static constexpr size_t header_size = (sizeof(chunk) + alignment - 1) / alignment * alignment;
+
+    // Each entry is a pointer to the entry below, followed by the element.
+    static constexpr size_t link_size = max(sizeof(byte*), alignof(element));
+
+    static byte*& below(byte* e) { return *reinterpret_cast<byte**>(e); }
+    static element* element_at(byte* e) { return std::launder(reinterpret_cast<element*>(e + link_size)); }
+
+    static byte* align(byte* pos) {
+        return reinterpret_cast<byte*>((reinterpret_cast<uintptr_t>(pos) + alignof(element) - 1) & ~(alignof(element) - 1));
+    }
+    static byte* end_of(byte* e) { return align(e + link_size + element_at(e)->extent()); }
+
+    void reset() {
+        m_current = m_first;
+        m_free = m_first == nullptr ? nullptr : m_first->begin();
+    }
+
+    // Find room for an entry with an object of the given size and alignment, at the start of the next chunk if the current one is
+    // full. The stack only moves to that chunk in commit, so it is unchanged if the constructor of the object throws.
+    byte* place(size_t size, size_t object_alignment) {
+        if (m_current != nullptr && m_current->fits(m_free + link_size + element::extent_at(m_free + link_size, size, object_alignment)))
+            return m_free;
+
+        size_t needed = link_size + sizeof(element) + object_alignment + size;
+        chunk* next = m_current == nullptr ? m_first : m_current->m_next;
+        if (next == nullptr || !next->fits(next->begin() + needed)) {
+            // Allocate a chunk and put it before any unused chunk which is too small.
+            size_t capacity = max((needed + alignof(element) - 1) / alignof(element) * alignof(element), ChunkSize);
+            chunk* c = new(operator new(header_size + capacity, align_val_t(alignment))) chunk(m_current, capacity);
+            c->m_next = next;
+            if (next != nullptr)
+                next->m_previous = c;
+            if (m_current == nullptr)
+                m_first = c;
+            else
+                m_current->m_next = c;
+            next = c;
+        }
+        return next->begin();
+    }
+
+    // Called after an element has been constructed in the entry at where, which place found in m_current or the chunk after it.
+    void commit(byte* where) {
+        if (m_current == nullptr)
+            m_current = m_first;
+        else if (!m_current->contains(where))
+            m_current = m_current->m_next;
+        new(where) byte*(m_top);
+        m_top = where;
+        m_free = end_of(where);
+        m_size++;
+    }
+
+    static void free_chunks(chunk* c) {
+        while (c != nullptr)
+            operator delete(exchange(c, c->m_next), align_val_t(alignment));
+    }
+
+    // Destroy the frames and free the chunks. The chunk pointers are left dangling, so this is followed by steal or the end of the
+    // stack's lifetime.
+    void release() {
+        clear();
+        free_chunks(m_first);
+    }
+
+    void steal(polymorphic_stack& src) {
+        m_first = exchange(src.m_first, nullptr);
+        m_current = exchange(src.m_current, nullptr);
+        m_free = exchange(src.m_free, nullptr);
+        m_top = exchange(src.m_top, nullptr);
+        m_size = exchange(src.m_size, 0);
+    }
+
+    chunk* m_first = nullptr;
+    chunk* m_current = nullptr;     // The chunk of the top entry, or where the next push goes.
+    byte* m_free = nullptr;         // Where the next entry goes in m_current.
+    byte* m_top = nullptr;          // The top entry.
+    size_t m_size = 0;
+};
+
+
+}       // Namespace std or stdx
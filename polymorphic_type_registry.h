@@ -0,0 +1,64 @@
+/*
+
+Registry of decoders which construct subclasses in polymorphic_values from serialized bytes. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <cstdint>          // uint32_t
+#include <span>
+#include <stdexcept>        // invalid_argument
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Maps type ids to decoders which emplace an object of the corresponding subclass of T in a polymorphic_value<T, Options>, given
+/// the serialized bytes of the object. The type ids index a table, so they should be small integers. A U which is constructible from
+/// span<const byte> can be registered with add<U>(id), other Us with a decoder function, which can be a lambda without captures.
+///
+/// Registration is not thread safe, decoding is as the registry is not modified by it.
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_type_registry {
+public:
+    using value_type = polymorphic_value<T, Options>;
+    using decoder = void (*)(value_type& dest, span<const byte> bytes);
+
+    template<typename U> void add(uint32_t id) requires is_base_of_v<T, U> && is_constructible_v<U, span<const byte>> {
+        add(id, [](value_type& dest, span<const byte> bytes) { dest.template emplace<U>(bytes); });
+    }
+    void add(uint32_t id, decoder d) {
+        if (id >= m_decoders.size())
+            m_decoders.resize(id + 1);
+        m_decoders[id] = d;
+    }
+
+    bool contains(uint32_t id) const { return find(id) != nullptr; }
+
+    // Returns nullptr if no decoder is registered for id.
+    decoder find(uint32_t id) const { return id < m_decoders.size() ? m_decoders[id] : nullptr; }
+
+    // Replace the object in dest by the decoded object, throws invalid_argument if id is not registered.
+    void decode(uint32_t id, span<const byte> bytes, value_type& dest) const {
+        decoder d = find(id);
+        if (d == nullptr)
+            throw invalid_argument("polymorphic_type_registry: unknown type id");
+        d(dest, bytes);
+    }
+
+private:
+    vector<decoder> m_decoders;
+};
+
+
+}       // Namespace std or stdx
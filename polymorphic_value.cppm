@@ -0,0 +1,30 @@
+/*
+
+C++20 module interface for polymorphic_value: import stdx.polymorphic_value;
+
+The module exports the declarations of polymorphic_value.h, which is included in the module purview with POLYMORPHIC_VALUE_EXPORT
+defined as export. Importers only parse the standard library headers they include themselves, the ones polymorphic_value.h needs
+are parsed once when the module is built. The header can still be included directly where modules are not available.
+
+The optional headers for comparison, batched destruction and statistics are not part of the module: with GCC 12 an importer which
+includes <vector> miscompiles vector's members if <vector> or <functional> is also in the global module fragment below.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+export module stdx.polymorphic_value;
+
+#define POLYMORPHIC_VALUE_EXPORT export
+#include "polymorphic_value.h"
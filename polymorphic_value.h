@@ -29,21 +29,45 @@ Further information at: https://opensource.org/licenses/MIT.
 #pragma once
 
 #include <memory>           // unique_ptr
+#include <new>              // align_val_t, destroying_delete
 #include <type_traits>      // is_copy_constructible, is_move_constructible
 #include <utility>          // construct_at, destroy_at
 #include <optional>         // nullopt
-#include <algorithm>        // all_of, max_element
+#include <algorithm>        // all_of, max_element, copy_n
 #include <initializer_list>
+#include <cstdint>          // uintptr_t, uint64_t
+
+// Optional USDT probes which let bpftrace or perf trace heap allocations, deep copies and type changes in a running process. Define
+// POLYMORPHIC_VALUE_USDT to 1 to compile them in, this requires <sys/sdt.h> from systemtap. Otherwise no code is generated.
+#if POLYMORPHIC_VALUE_USDT
+#include <sys/sdt.h>
+#include <typeinfo>
+#define POLYMORPHIC_VALUE_PROBE(name, ...) STAP_PROBEV(polymorphic_value, name, __VA_ARGS__)
+#else
+#define POLYMORPHIC_VALUE_PROBE(name, ...)
+#endif
+
+// Prefetch for reading, to all cache levels. A no-op on compilers without the builtin.
+#if defined(__GNUC__) || defined(__clang__)
+#define POLYMORPHIC_VALUE_PREFETCH(address) __builtin_prefetch(address, 0, 3)
+#else
+#define POLYMORPHIC_VALUE_PREFETCH(address)
+#endif
+
+// Expands to export where polymorphic_value.cppm includes this header in the module stdx.polymorphic_value.
+#ifndef POLYMORPHIC_VALUE_EXPORT
+#define POLYMORPHIC_VALUE_EXPORT
+#endif
 
 #if IS_STANDARDIZED
 
 #define STD std
-namespace std {
+POLYMORPHIC_VALUE_EXPORT namespace std {
 
 #else
 
 #define STD stdx
-namespace stdx {
+POLYMORPHIC_VALUE_EXPORT namespace stdx {
 
 using namespace std;
 
@@ -59,32 +83,117 @@ struct polymorphic_value_options {
     bool heap = true;
     bool copy = true;
     bool move = true;
+    bool statistics = false;    // Count emplace/copy/move/destroy and heap allocations per polymorphic_value type.
+    bool share_handlers = false;    // Use one handler per size for trivially copyable Us which have T at offset 0.
+    bool compare = false;       // Provide operator== and operator<=> using U's comparison operators.
+    bool hash = false;          // Provide hash() and std::hash using std::hash<U>.
+    bool cache_hash = false;    // As hash, but store the hash value in the polymorphic_value after it has been computed.
+    bool zero_offset = false;   // With heap = false: require T at offset 0 in all Us so that get() needs no virtual call.
+    bool deferred_destroy = false;  // Destroy heap allocated Us on the reclaimer thread, see polymorphic_value_reclaimer.h.
+    bool generation = false;    // Count non-const accesses and changes of the object, see generation() and polymorphic_value_memo.
+    bool huge_pages = false;    // Allocate Us which don't fit the SBO buffer from polymorphic_value_huge_page_heap.h.
+};
+
+
+/// Snapshot of the counters of one polymorphic_value type and the registry behind it. They are only declared here, include
+/// polymorphic_value_statistics.h where the statistics option is used.
+struct polymorphic_value_statistics;
+class polymorphic_value_counters;
+
+/// The counters of a polymorphic_value type with the statistics option.
+enum class polymorphic_value_counter { emplaces, copies, moves, destroys, allocations, deallocations, allocated_bytes };
+
+// Count n on counter of the polymorphic_value type Value, and take a snapshot of its counters. Counters is a template parameter for
+// the same reason as Reclaimer in polymorphic_value_retire below.
+template<typename Value, typename Counters = polymorphic_value_counters> void polymorphic_value_count(polymorphic_value_counter counter, size_t n) {
+    Counters::template count<Value>(counter, n);
+}
+template<typename Value, typename Counters = polymorphic_value_counters> auto polymorphic_value_snapshot() {
+    return Counters::template instance<Value>().snapshot();
+}
+
+
+/// Process wide thread which destroys heap allocated objects retired by polymorphic_values with the deferred_destroy option. It is
+/// only declared here, include polymorphic_value_reclaimer.h where the deferred_destroy option or deferred_destroy() is used.
+class polymorphic_value_reclaimer;
+
+/// Function which hands an object to a reclaimer thread, which destroys it by calling deleter with it.
+using polymorphic_value_retire_function = void (*)(void* object, void (*deleter)(void*));
+
+// Retire object on Reclaimer::instance(). Reclaimer is a template parameter so that its definition is only needed where this is
+// instantiated, which is for the deferred_destroy option, deferred_destroy() and clear or destroy_range with a reclaimer.
+template<typename Reclaimer = polymorphic_value_reclaimer> void polymorphic_value_retire(void* object, void (*deleter)(void*)) {
+    Reclaimer::instance().retire(object, deleter);
+}
+
+
+/// destroy_range and clear, which destroy the objects of many polymorphic_values in one pass. Only declared here, include
+/// polymorphic_value_batch_destroy.h where they are used.
+struct polymorphic_value_batch_destroy;
+
+
+/// Process wide heap for the Us of polymorphic_values with the huge_pages option which don't fit the SBO buffer. It is only declared
+/// here, include polymorphic_value_huge_page_heap.h where the huge_pages option is used.
+class polymorphic_value_huge_page_heap;
+
+// Allocate and free on Heap::instance(). Heap is a template parameter for the same reason as Reclaimer in polymorphic_value_retire.
+template<typename Heap = polymorphic_value_huge_page_heap> void* polymorphic_value_heap_allocate(size_t size, size_t alignment) {
+    return Heap::instance().allocate(size, alignment);
+}
+template<typename Heap = polymorphic_value_huge_page_heap> void polymorphic_value_heap_deallocate(void* object, size_t size, size_t alignment) {
+    Heap::instance().deallocate(object, size, alignment);
+}
+
+
+/// Comparison and hashing of polymorphic_values with the compare, hash and cache_hash options, and the storage of the hash value
+/// for cache_hash. Without the cache_hash option the storage is an empty base class which takes no space. They are only declared
+/// here, include polymorphic_value_compare.h where one of the options is used.
+struct polymorphic_value_comparison;
+template<bool Cached> struct polymorphic_value_hash_cache {};
+template<> struct polymorphic_value_hash_cache<true>;
+
+/// Result of the comparison of two objects of the same U by their handler, see polymorphic_value_comparison.
+enum class polymorphic_value_order : signed char { less = -1, equivalent = 0, greater = 1, unordered = 2 };
+
+
+/// Generation counter of a polymorphic_value with the generation option. Without the option it is an empty base class which takes no
+/// space.
+template<bool Counted> struct polymorphic_value_generation {};
+template<> struct polymorphic_value_generation<true> {
+    uint64_t m_generation = 0;
 };
 
-template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_value {
+
+template<typename T, polymorphic_value_options Options = polymorphic_value_options{}> class polymorphic_value
+    : private polymorphic_value_hash_cache<Options.cache_hash>, private polymorphic_value_generation<Options.generation> {
     // Copies of the options, adjusted for properties of T
     static const size_t sbo_size = Options.heap ? (Options.size >= sizeof(T) ? Options.size : 0) : max(Options.size, sizeof(T));
     static const size_t alignment = max(alignof(T), Options.alignment);
     static const bool allow_heap_allocation = Options.heap;
     static const bool copyable = Options.copy && is_copy_constructible_v<T>;
     static const bool movable = Options.move && is_move_constructible_v<T>;
+    static const bool hashable = Options.hash || Options.cache_hash;
+    static const bool direct_access = Options.zero_offset;
+
+    static_assert(!Options.zero_offset || !Options.heap, "The zero_offset option requires the heap option to be false");
 
 public:
     polymorphic_value() {}
     polymorphic_value(nullopt_t) {}
-    polymorphic_value(const polymorphic_value& src) requires copyable {
+    polymorphic_value(const polymorphic_value& src) requires copyable : polymorphic_value_hash_cache<Options.cache_hash>(src) {
         std::launder(&src.m_handler)->copy(*this, src.m_data);
     }
-    polymorphic_value(polymorphic_value&& src) requires movable {
-        std::launder(&src.m_handler)->move(*this, src.m_data);
-        src.reset();
+    polymorphic_value(polymorphic_value&& src) requires movable : polymorphic_value_hash_cache<Options.cache_hash>(src) {
+        std::launder(&src.m_handler)->relocate(*this, src.m_data);
+        src.relocated();
     }
     template<typename U, typename... Args> polymorphic_value(in_place_type_t<U>, Args&&... args) requires is_base_of_v<T, U> {
-        emplace<U>(forward<Args>(args)...);
+        construct<U>(forward<Args>(args)...);       // Nothing to destroy, which saves the virtual call emplace would do.
     }
 
     ~polymorphic_value() {
-        std::launder(&m_handler)->destroy(m_data);
+        if (!is_empty_handler(m_handler))     // Cheaper than a virtual call for moved from and reset values.
+            std::launder(&m_handler)->destroy(m_data);
     }
 
     // static make function which could be somewhat more ergonomic than the in_place_type constructor, especially after creating a
@@ -93,12 +202,31 @@ public:
         return polymorphic_value(in_place_type<U>, forward<Args>(args)...);
     }
 
+    // Move construct *dest from *src and end the lifetime of *src using one virtual call. dest must point to uninitialized storage
+    // and *src must not be used or destroyed afterwards. This is intended for containers which move their elements.
+    friend void relocate_at(polymorphic_value* src, polymorphic_value* dest) requires movable {
+        new(dest) polymorphic_value(*static_cast<polymorphic_value_hash_cache<Options.cache_hash>*>(src));
+        std::launder(&src->m_handler)->relocate(*dest, src->m_data);
+    }
+
+    // Reset v, handing a heap allocated object to the reclaimer thread instead of destroying it, see polymorphic_value_reclaimer.
+    // Objects in the SBO buffer are destroyed directly. With the deferred_destroy option this is what reset() does.
+    friend void deferred_destroy(polymorphic_value&& v) {
+        std::launder(&v.m_handler)->retire(v.m_data, &polymorphic_value_retire<>);
+        v.relocated();
+    }
+
+    // Counters aggregated over all threads since program start. Only available if the statistics option is set.
+    static auto statistics() requires (Options.statistics) { return polymorphic_value_snapshot<polymorphic_value>(); }
+
     polymorphic_value& operator=(const polymorphic_value& src) requires copyable {
         if (this == &src)
             return *this;
 
         std::launder(&m_handler)->destroy(m_data);
         std::launder(&src.m_handler)->copy(*this, src.m_data);
+        polymorphic_value_hash_cache<Options.cache_hash>::operator=(src);
+        advance_generation();
         return *this;
     };
 
@@ -107,37 +235,40 @@ public:
             return *this;
 
         std::launder(&m_handler)->destroy(m_data);
-        std::launder(&src.m_handler)->move(*this, src.m_data);
-        src.reset();
+        std::launder(&src.m_handler)->relocate(*this, src.m_data);
+        polymorphic_value_hash_cache<Options.cache_hash>::operator=(src);
+        advance_generation();
+        src.relocated();
         return *this;
     };
 
     // Create object of subclass U of T, or by default a T.
     template<typename U = T, typename... Args> void emplace(Args&&... args) requires is_base_of_v<T, U> {
-        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
-        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the copy option must be set to false");
-        static_assert(allow_heap_allocation || sizeof(U) <= sbo_size, "The class does not fit in the polymorphic_value");
-        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
-
+#if POLYMORPHIC_VALUE_USDT
+        const type_info& old_handler = typeid(*std::launder(&m_handler));
+#endif
         std::launder(&m_handler)->destroy(m_data);
-        if constexpr (sizeof(U) <= sbo_size) {
-            new(&m_handler) small_handler<U>;
-            construct_at(reinterpret_cast<U*>(m_data.m_bytes), forward<Args>(args)...);
-        }
-        else {
-            new(&m_handler) big_handler<U>;
-            construct_at(&m_data.m_ptr, make_unique<U>(forward<Args>(args)...));
-        }
+        new(&m_handler) handler_base;       // Stays empty if the constructor of U throws.
+        modified();
+        construct<U>(forward<Args>(args)...);
+#if POLYMORPHIC_VALUE_USDT
+        if (old_handler != typeid(handler_base) && old_handler != typeid(*std::launder(&m_handler)))
+            POLYMORPHIC_VALUE_PROBE(type_change, this, sizeof(U), typeid(U).name());
+#endif
     }
 
     // Get rid of a stored object, resetting the handler so that no double delete occurs later and so that operator bool returns false.
-    void reset() { std::launder(&m_handler)->destroy(m_data); new(&m_handler) handler_base; }
+    void reset() { std::launder(&m_handler)->destroy(m_data); new(&m_handler) handler_base; modified(); }
 
     operator bool() const { return get() != nullptr; }
 
-    // Access the stored object. This is the unique_ptr API to allow for drop in replacement.
-    T* get() { return std::launder(&m_handler)->get(m_data); }
-    const T* get() const { return const_cast<polymorphic_value*>(this)->get(); }
+    // Access the stored object. This is the unique_ptr API to allow for drop in replacement. Non-const access counts as a change of
+    // the object for the cache_hash and generation options.
+    T* get() {
+        modified();
+        return object();
+    }
+    const T* get() const { return object(); }
 
     T& operator*() { return *get(); }
     const T& operator*() const { return *get(); }
@@ -145,6 +276,28 @@ public:
     T* operator->() { return get(); }
     const T* operator->() const { return get(); }
 
+    // Start loading a heap allocated object into the cache, to hide the latency of the pointer chase when the object is accessed a
+    // while later. To avoid a virtual call, which is mispredicted when the Us vary, the first word of m_data is prefetched whether
+    // it is the unique_ptr or the start of an object in the SBO buffer. This is harmless as a prefetch never faults, and the first
+    // word of an SBO object is usually its vtable pointer which is in the cache anyway. Without heap allocation nothing is done.
+    void prefetch() const {
+        if constexpr (allow_heap_allocation) {
+            const void* object;
+            copy_bytes(&object, &m_data, sizeof(object));
+            POLYMORPHIC_VALUE_PREFETCH(object);
+        }
+    }
+
+    // Number of non-const accesses and changes of the object since construction, available with the generation option. A copy or
+    // move constructed value starts from 0. Used by polymorphic_value_memo to tell whether the object may have changed.
+    uint64_t generation() const requires (Options.generation) { return this->m_generation; }
+
+    // Hash value of the stored object using std::hash<U>, or 0 if empty. Available with the hash or cache_hash options. With
+    // cache_hash the value is stored until the object is accessed through a non-const member.
+    template<typename Comparison = polymorphic_value_comparison> size_t hash() const requires (hashable) {
+        return Comparison::hash(*this);
+    }
+
     // optional API
     // Maybe a holds_alternative<U> from variant is more appropriate? But viewing different subclasses as alternatives seems a bit
     // misleading.
@@ -223,6 +376,114 @@ public:
     }
 
 private:
+    friend struct polymorphic_value_comparison;
+    friend struct polymorphic_value_batch_destroy;
+
+    using counter = polymorphic_value_counter;
+
+    // The counters are only instantiated when the statistics option is set, otherwise count() is empty.
+    static void count(counter c, size_t n = 1) {
+        if constexpr (Options.statistics)
+            polymorphic_value_count<polymorphic_value>(c, n);
+    }
+
+    // Private constructor for relocate_at, which only needs the cached hash value.
+    explicit polymorphic_value(const polymorphic_value_hash_cache<Options.cache_hash>& hash_cache)
+        : polymorphic_value_hash_cache<Options.cache_hash>(hash_cache) {}
+
+    // What destroy_objects needs to know about the U of a handler to destroy it without a virtual call. Trivially destructible Us
+    // need no destructor call, and if they are on the heap the block of size bytes starts offset bytes before the T.
+    struct destroy_info {
+        bool trivial = false;
+        bool heap = false;
+        ptrdiff_t offset = 0;
+        size_t size = 0;
+    };
+
+    // True if delete of a U* finds an operator delete of U or a base class. Name lookup alone fails for an overloaded operator delete,
+    // so a call of each form a class can declare is checked.
+    template<typename U> static constexpr bool has_class_operator_delete =
+        requires(U* p) { U::operator delete(p); } || requires(U* p) { U::operator delete(p, sizeof(U)); } ||
+        requires(U* p) { U::operator delete(p, align_val_t(alignof(U))); } ||
+        requires(U* p) { U::operator delete(p, sizeof(U), align_val_t(alignof(U))); } ||
+        requires(U* p) { U::operator delete(p, destroying_delete); } ||
+        requires(U* p) { U::operator delete(p, destroying_delete, sizeof(U)); } ||
+        requires(U* p) { U::operator delete(p, destroying_delete, align_val_t(alignof(U))); } ||
+        requires(U* p) { U::operator delete(p, destroying_delete, sizeof(U), align_val_t(alignof(U))); };
+
+    // Reset after the object has been relocated to another polymorphic_value, so there is nothing to destroy.
+    void relocated() { new(&m_handler) handler_base; modified(); }
+
+    T* object() const {
+        data& d = const_cast<data&>(m_data);
+        if constexpr (direct_access)
+            return is_empty_handler(m_handler) ? nullptr : std::launder(reinterpret_cast<T*>(d.m_bytes));
+        else
+            return std::launder(&m_handler)->get(d);
+    }
+
+    // Called when the object may change.
+    void modified() {
+        if constexpr (Options.cache_hash)
+            this->clear_cached_hash();
+        advance_generation();
+    }
+    void advance_generation() {
+        if constexpr (Options.generation)
+            this->m_generation++;
+    }
+
+    // Allocate and free Us which don't fit the SBO buffer, from polymorphic_value_huge_page_heap with the huge_pages option.
+    template<typename U, typename... Args> static unique_ptr<T> new_object(Args&&... args) {
+        if constexpr (Options.huge_pages) {
+            void* storage = polymorphic_value_heap_allocate(sizeof(U), alignof(U));
+            try {
+                return unique_ptr<T>(construct_at(static_cast<U*>(storage), forward<Args>(args)...));
+            }
+            catch (...) {
+                polymorphic_value_heap_deallocate(storage, sizeof(U), alignof(U));
+                throw;
+            }
+        }
+        else
+            return make_unique<U>(forward<Args>(args)...);
+    }
+    template<typename U> static void delete_object(U* object) {
+        if constexpr (Options.huge_pages) {
+            destroy_at(object);
+            polymorphic_value_heap_deallocate(object, sizeof(U), alignof(U));
+        }
+        else
+            delete object;
+    }
+
+    // Construct a U in m_data, which must not contain an object and have the empty handler. As for copies the handler of U is set
+    // after the U has been constructed, so that the value is still empty if the constructor throws.
+    template<typename U, typename... Args> void construct(Args&&... args) {
+        static_assert(!copyable || is_copy_constructible_v<U>, "To use a non-copyable subclass the copy option must be set to false");
+        static_assert(!movable || is_move_constructible_v<U>, "To use a non-movable subclass the copy option must be set to false");
+        static_assert(allow_heap_allocation || sizeof(U) <= sbo_size, "The class does not fit in the polymorphic_value");
+        static_assert(alignof(U) <= alignment, "The class has a higher alignment requirement than specified");
+        static_assert(!Options.zero_offset || zero_offset<U>(), "With the zero_offset option T must be at offset 0 in the class");
+
+        if constexpr (sizeof(U) <= sbo_size && shares_handler<U>) {
+            construct_at(reinterpret_cast<U*>(m_data.m_bytes), forward<Args>(args)...);
+            new(&m_handler) trivial_handler<sizeof(U)>;
+        }
+        else if constexpr (sizeof(U) <= sbo_size) {
+            construct_at(reinterpret_cast<U*>(m_data.m_bytes), forward<Args>(args)...);
+            new(&m_handler) small_handler<U>;
+        }
+        else {
+            construct_at(&m_data.m_ptr, new_object<U>(forward<Args>(args)...));
+            new(&m_handler) big_handler<U>;
+            count(counter::allocations);
+            count(counter::allocated_bytes, sizeof(U));
+            POLYMORPHIC_VALUE_PROBE(heap_alloc, m_data.m_ptr.get(), sizeof(U), typeid(U).name());
+        }
+        count(counter::emplaces);
+    }
+
     union data {
         data() : m_ptr(nullptr) {}
         ~data() {}
@@ -240,9 +501,112 @@ private:
 
         virtual void copy(polymorphic_value& dest, const data& src) const {}
         virtual void move(polymorphic_value& dest, data& src) const {}
+        virtual void relocate(polymorphic_value& dest, data& src) const {}     // move followed by destroy of src.
         virtual void destroy(data& d) const {}
+        // destroy, but passing a heap allocated object to retire instead of deleting it.
+        virtual void retire(data& d, polymorphic_value_retire_function retire) const { destroy(d); }
+
+        // Compare or hash objects if the corresponding options are set. Both operands of equals and compare have this handler.
+        virtual bool equals(const data& lhs, const data& rhs) const { return true; }
+        virtual polymorphic_value_order compare(const data& lhs, const data& rhs) const { return polymorphic_value_order::equivalent; }
+        virtual size_t hash(const data& d) const { return 0; }
+
+        virtual destroy_info get_destroy_info(const data& d) const { return {}; }
     };
-    
+
+    // Copy an object representation. Like memcpy, which the standard library calls for copy_n of bytes, but without <cstring>.
+    static void copy_bytes(void* dest, const void* src, size_t size) {
+        copy_n(static_cast<const byte*>(src), size, static_cast<byte*>(dest));
+    }
+
+    // Handlers have no data members, so their object representation is their vtable pointer, and two handlers are of the same
+    // class exactly when these are equal. This is cheaper than a virtual call and does not require RTTI.
+    static uintptr_t vtable_of(const handler_base& h) {
+        static_assert(sizeof(handler_base) == sizeof(uintptr_t));
+        uintptr_t ret;
+        copy_bytes(&ret, &h, sizeof(ret));
+        return ret;
+    }
+    static bool same_handler(const handler_base& lhs, const handler_base& rhs) { return vtable_of(lhs) == vtable_of(rhs); }
+    static bool is_empty_handler(const handler_base& h) {
+        handler_base empty;
+        return same_handler(h, empty);
+    }
+
+    // Handler classes are identified by their vtable pointer, so the destroy_info of a handler can be looked up without a call. The
+    // cache is direct mapped on a hash of the vtable pointer to make the lookup branch predictable even if the Us of consecutive
+    // elements vary. On a collision the entry is replaced.
+    class destroy_info_cache {
+    public:
+        const destroy_info& find(const handler_base& h, const data& d) {
+            uintptr_t key = vtable_of(h);
+            entry& e = m_entries[key * 0x9E3779B97F4A7C15ull >> (64 - capacity_bits)];
+            if (e.key != key) {
+                e.key = key;
+                e.info = h.get_destroy_info(d);
+            }
+            return e.info;
+        }
+
+    private:
+        static const int capacity_bits = 5;
+
+        struct entry {
+            uintptr_t key = 0;
+            destroy_info info;
+        };
+        entry m_entries[1 << capacity_bits];
+    };
+
+    // Destroy the objects of a range of values in one pass for polymorphic_value_batch_destroy. Heap blocks of trivially
+    // destructible Us are added to blocks if it is not nullptr, otherwise freed directly. If reset is set the values are left empty.
+    template<typename It, typename Blocks>
+    static void destroy_objects(It first, It last, bool reset, destroy_info_cache& cache, Blocks* blocks) {
+        for (; first != last; ++first) {
+            polymorphic_value& v = *first;
+            if (is_empty_handler(v.m_handler))
+                continue;
+
+            const destroy_info& info = cache.find(*std::launder(&v.m_handler), v.m_data);
+            if (info.trivial) {
+                if (info.heap) {
+                    void* block = reinterpret_cast<byte*>(v.m_data.m_ptr.get()) - info.offset;
+                    if (blocks != nullptr)
+                        blocks->push_back(block);
+                    else
+                        ::operator delete(block, info.size);
+                    count(counter::deallocations);
+                }
+                count(counter::destroys);
+            }
+            else
+                std::launder(&v.m_handler)->destroy(v.m_data);
+            if (reset)
+                v.relocated();
+        }
+    }
+
+    // Implementations of the handlers' comparison and hashing for two objects of the same U.
+    template<typename U> static bool equal_objects(const U& lhs, const U& rhs) {
+        if constexpr (Options.compare)
+            return lhs == rhs;
+        else
+            return false;
+    }
+    template<typename U, typename Comparison = polymorphic_value_comparison>
+    static polymorphic_value_order compare_objects(const U& lhs, const U& rhs) {
+        if constexpr (Options.compare)
+            return Comparison::compare_objects(lhs, rhs);
+        else
+            return polymorphic_value_order::unordered;
+    }
+    template<typename U, typename Comparison = polymorphic_value_comparison> static size_t hash_object(const U& object) {
+        if constexpr (hashable)
+            return Comparison::template hash_object<T>(object);
+        else
+            return 0;
+    }
+
     // Handler for Us that fit the SBO size
     template<typename U> struct small_handler final : public handler_base {
         void imbue_handler(handler_base& dest) const override { }
@@ -254,7 +618,13 @@ private:
             new(&dest.m_handler) handler_base;
             if constexpr (is_copy_constructible_v<U>) // Always true thanks to requires clauses on constructors/assignment operators.
                 construct_at<U>(reinterpret_cast<U*>(dest.m_data.m_bytes), *reinterpret_cast<const U*>(src.m_bytes));
+            else {
+                POLYMORPHIC_VALUE_PROBE(copy_failed, &dest, sizeof(U), typeid(U).name());
+                return;
+            }
             new(&dest.m_handler) small_handler<U>; 
+            count(counter::copies);
+            POLYMORPHIC_VALUE_PROBE(deep_copy, &dest, sizeof(U), typeid(U).name());
         }
         
         void move(polymorphic_value& dest, data& src) const override {
@@ -262,11 +632,73 @@ private:
             if constexpr (is_move_constructible_v<U>)
                 construct_at<U>(reinterpret_cast<U*>(dest.m_data.m_bytes), std::move(*reinterpret_cast<U*>(src.m_bytes)));
             new(&dest.m_handler) small_handler<U>;
+            count(counter::moves);
+        }
+
+        void relocate(polymorphic_value& dest, data& src) const override {
+            move(dest, src);
+            destroy(src);
         }
 
-        void destroy(data& d) const override { destroy_at(reinterpret_cast<U*>(d.m_bytes)); }
+        void destroy(data& d) const override {
+            destroy_at(reinterpret_cast<U*>(d.m_bytes));
+            count(counter::destroys);
+        }
+
+        bool equals(const data& lhs, const data& rhs) const override { return equal_objects(object(lhs), object(rhs)); }
+        polymorphic_value_order compare(const data& lhs, const data& rhs) const override { return compare_objects(object(lhs), object(rhs)); }
+        size_t hash(const data& d) const override { return hash_object(object(d)); }
+
+        destroy_info get_destroy_info(const data& d) const override { return { is_trivially_destructible_v<U>, false }; }
+
+        static const U& object(const data& d) { return *reinterpret_cast<const U*>(d.m_bytes); }
     };
     
+    // Check if T is at offset 0 in U. The storage is never constructed, converting a pointer to a non-virtual base is allowed
+    // anyway. Conversion to a virtual base is not, so this is not a constant expression if T is a virtual base of U.
+    template<typename U> static constexpr bool zero_offset() {
+        allocator<U> alloc;
+        U* object = alloc.allocate(1);
+        bool ret = static_cast<void*>(static_cast<T*>(object)) == static_cast<void*>(object);
+        alloc.deallocate(object, 1);
+        return ret;
+    }
+
+    // With the share_handlers option Us for which copy, move and destroy only depend on the size use a trivial_handler instead of
+    // small_handler<U>. This requires that U is trivially copyable and destructible, which also excludes virtual bases, and that T
+    // is at offset 0 in U. As the handler does not identify U it can't be used with the compare and hash options.
+    template<typename U> static constexpr bool shares_handler = Options.share_handlers && !Options.compare && !hashable &&
+        is_trivially_copyable_v<U> && is_trivially_destructible_v<U> && zero_offset<U>();
+
+    // Handler shared by all Us of a certain size for which shares_handler is true.
+    template<size_t Size> struct trivial_handler final : public handler_base {
+        void imbue_handler(handler_base& dest) const override { }
+
+        T* get(data& d) const override { return std::launder(reinterpret_cast<T*>(d.m_bytes)); }
+        const T* get(const data& d) const override { return std::launder(reinterpret_cast<const T*>(d.m_bytes)); }
+
+        void copy(polymorphic_value& dest, const data& src) const override {
+            copy_bytes(dest.m_data.m_bytes, src.m_bytes, Size);
+            new(&dest.m_handler) trivial_handler;
+            count(counter::copies);
+        }
+
+        void move(polymorphic_value& dest, data& src) const override {
+            copy_bytes(dest.m_data.m_bytes, src.m_bytes, Size);
+            new(&dest.m_handler) trivial_handler;
+            count(counter::moves);
+        }
+
+        void relocate(polymorphic_value& dest, data& src) const override {
+            move(dest, src);
+            destroy(src);
+        }
+
+        void destroy(data& d) const override { count(counter::destroys); }
+
+        destroy_info get_destroy_info(const data& d) const override { return { true, false }; }
+    };
+
     // Handler for Us that don't fit the SBO size
     template<typename U> struct big_handler final : public handler_base {
         void imbue_handler(handler_base& dest) const override { new(&dest) big_handler<U>; }
@@ -277,50 +709,134 @@ private:
         void copy(polymorphic_value& dest, const data& src) const override { 
             new(&dest.m_handler) handler_base;
             if constexpr (is_copy_constructible_v<U>)
-                construct_at(&dest.m_data.m_ptr, make_unique<U>(static_cast<const U&>(*src.m_ptr)));
+                construct_at(&dest.m_data.m_ptr, new_object<U>(static_cast<const U&>(*src.m_ptr)));
+            else {
+                POLYMORPHIC_VALUE_PROBE(copy_failed, &dest, sizeof(U), typeid(U).name());
+                return;
+            }
             new(&dest.m_handler) big_handler<U>;
+            count(counter::copies);
+            count(counter::allocations);
+            count(counter::allocated_bytes, sizeof(U));
+            POLYMORPHIC_VALUE_PROBE(heap_alloc, dest.m_data.m_ptr.get(), sizeof(U), typeid(U).name());
+            POLYMORPHIC_VALUE_PROBE(deep_copy, &dest, sizeof(U), typeid(U).name());
         }
         void move(polymorphic_value& dest, data& src) const override {
             new(&dest.m_handler) handler_base;
             if constexpr (is_move_constructible_v<U>)
                 construct_at(&dest.m_data.m_ptr, std::move(src.m_ptr));
             new(&dest.m_handler) big_handler<U>;
+            count(counter::moves);
         }
 
-        void destroy(data& d) const override { destroy_at(&d.m_ptr); }
+        void relocate(polymorphic_value& dest, data& src) const override {
+            move(dest, src);
+            destroy_at(&src.m_ptr);     // The pointer is empty now, so no object is destroyed or counted.
+        }
+
+        void destroy(data& d) const override {
+            if constexpr (Options.deferred_destroy)
+                retire(d, &polymorphic_value_retire<>);
+            else {
+                if (d.m_ptr != nullptr) {
+                    count(counter::deallocations);
+                    delete_object(static_cast<U*>(d.m_ptr.release()));
+                }
+                destroy_at(&d.m_ptr);
+                count(counter::destroys);
+            }
+        }
+        void retire(data& d, polymorphic_value_retire_function retire) const override {
+            if (d.m_ptr != nullptr) {
+                count(counter::deallocations);
+                retire(static_cast<U*>(d.m_ptr.release()), [](void* object) { delete_object(static_cast<U*>(object)); });
+            }
+            destroy_at(&d.m_ptr);
+            count(counter::destroys);
+        }
+
+        bool equals(const data& lhs, const data& rhs) const override { return equal_objects(object(lhs), object(rhs)); }
+        polymorphic_value_order compare(const data& lhs, const data& rhs) const override { return compare_objects(object(lhs), object(rhs)); }
+        size_t hash(const data& d) const override { return hash_object(object(d)); }
+
+        // The block can only be freed directly if it was allocated by the global operator new without alignment.
+        destroy_info get_destroy_info(const data& d) const override {
+            if constexpr (is_trivially_destructible_v<U> && alignof(U) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__ && !Options.huge_pages &&
+                          !has_class_operator_delete<U>) {
+                const T* object = d.m_ptr.get();
+                return { true, true, reinterpret_cast<const byte*>(object) - reinterpret_cast<const byte*>(static_cast<const U*>(object)),
+                         sizeof(U) };
+            }
+            else
+                return {};
+        }
+
+        static const U& object(const data& d) { return static_cast<const U&>(*d.m_ptr); }
     };
 
     data m_data;
     handler_base m_handler;     // Should be after m_data to avoid a hole if data has a larger alignment than a pointer.
 };
 
-#if 0 // I thought this should work but it gives me std::ranges_dangling from max_element et al.
-// Create polymorphic_value_options suitable for a closed set of SubClasses
-template<typename... SubClasses> constexpr polymorphic_value_options polymorphic_value_options_for = {
-    .size = size_t(*ranges::max_element(initializer_list<size_t>{ sizeof(SubClasses)... })),
-    .alignment = *ranges::max_element(initializer_list<size_t>{ alignof(SubClasses)... }),
-    .heap = false,
-    .copy = ranges::all_of(initializer_list<size_t>{std::is_copy_constructible_v<SubClasses>...}, [](bool x) { return x; }),
-    .move = ranges::all_of(initializer_list<size_t>{std::is_move_constructible_v<SubClasses>...}, [](bool x) { return x; })
+/// The result of f called with the object of a polymorphic_value with the generation option, which is only recomputed when the
+/// generation of the value has changed since the previous call. For an empty value the result is value initialized instead. Changes
+/// made through a pointer or reference which was obtained from the value before the previous call are not detected. The memo refers
+/// to the value, which must outlive it.
+template<typename T, polymorphic_value_options Options, typename F> requires (Options.generation) class polymorphic_value_memo {
+public:
+    using result_type = remove_cvref_t<invoke_result_t<F&, const T&>>;
+
+    polymorphic_value_memo(const polymorphic_value<T, Options>& value, F f) : m_value(&value), m_function(std::move(f)) {}
+
+    const result_type& operator()() {
+        uint64_t generation = m_value->generation();
+        if (!m_result || generation != m_generation) {
+            const T* object = m_value->get();
+            if (object != nullptr)
+                m_result.emplace(m_function(*object));
+            else
+                m_result.emplace();
+            m_generation = generation;
+        }
+        return *m_result;
+    }
+
+    // Recompute on the next call even if the value has not changed, for instance if f also depends on something else.
+    void invalidate() { m_result.reset(); }
+
+private:
+    const polymorphic_value<T, Options>* m_value;
+    F m_function;
+    optional<result_type> m_result;
+    uint64_t m_generation = 0;
 };
-#else
 
+// Call f with each element of a range of polymorphic_values, prefetching the heap allocated object of the element distance positions
+// ahead. A good distance covers the memory latency with the work f does on the elements in between, typically 4 to 16.
+template<typename Range, typename F> void for_each_prefetched(Range&& range, size_t distance, F&& f) {
+    auto ahead = begin(range);
+    auto last = end(range);
+    for (size_t i = 0; i < distance && ahead != last; i++, ++ahead)
+        ahead->prefetch();
+
+    for (auto current = begin(range); current != last; ++current) {
+        if (ahead != last) {
+            ahead->prefetch();
+            ++ahead;
+        }
+        f(*current);
+    }
+}
+
+// Create polymorphic_value_options suitable for a closed set of SubClasses. Pack expansions instead of recursion keep the
+// instantiation depth constant, so that the set can contain thousands of subclasses.
 template<typename S, typename... Ss> constexpr polymorphic_value_options polymorphic_value_options_for = {
-    .size = max(sizeof(S), polymorphic_value_options_for<Ss...>.size),
-    .alignment = max(alignof(S), polymorphic_value_options_for<Ss...>.alignment),
+    .size = max({ sizeof(S), sizeof(Ss)... }),
+    .alignment = max({ alignof(S), alignof(Ss)... }),
     .heap = false,
-    .copy = is_copy_constructible_v<S> && polymorphic_value_options_for<Ss...>.copy,
-    .move = is_move_constructible_v<S> && polymorphic_value_options_for<Ss...>.move
+    .copy = is_copy_constructible_v<S> && (is_copy_constructible_v<Ss> && ...),
+    .move = is_move_constructible_v<S> && (is_move_constructible_v<Ss> && ...)
 };
-template<typename S> constexpr polymorphic_value_options polymorphic_value_options_for<S> = {
-    .size = sizeof(S),
-    .alignment = alignof(S),
-    .heap = false,
-    .copy = is_copy_constructible_v<S>,
-    .move = is_move_constructible_v<S>
-};
-
-#endif
 
 // Type alias suitable for a polymorphic_value able to hold all of the subclasses.
 template<typename T, typename... SubClasses> using polymorphic_value_for = polymorphic_value<T, polymorphic_value_options_for<SubClasses...>>; 
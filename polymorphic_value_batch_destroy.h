@@ -0,0 +1,101 @@
+/*
+
+Batched destruction of ranges and vectors of polymorphic_values by destroy_range and clear. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <algorithm>        // min
+#include <cstddef>          // size_t
+#include <memory>           // unique_ptr
+#include <new>              // operator delete
+#include <type_traits>      // remove_cvref
+#include <vector>
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Destroys the objects of many polymorphic_values in one pass. Instead of a virtual destroy call per element the handler of each U
+/// is asked once whether U is trivially destructible, and such objects are skipped or only have their heap block freed. With a
+/// retire function the heap blocks are retired to a reclaimer thread which frees them. Used by the free functions destroy_range
+/// and clear below.
+struct polymorphic_value_batch_destroy {
+    // Destroy the values in [first, last), which ends their lifetime.
+    template<typename It> static void destroy_range(It first, It last, polymorphic_value_retire_function retire) {
+        using value = remove_cvref_t<decltype(*first)>;
+
+        typename value::destroy_info_cache cache;
+        vector<void*> blocks;
+        value::destroy_objects(first, last, false, cache, retire != nullptr ? &blocks : nullptr);
+        free_blocks(std::move(blocks), retire);
+    }
+
+    // Clear a vector in blocks from the back, so that each block of values is still in the cache when the vector destroys the
+    // now empty values.
+    template<typename T, polymorphic_value_options Options, typename Allocator>
+    static void clear(vector<polymorphic_value<T, Options>, Allocator>& values, polymorphic_value_retire_function retire) {
+        using value = polymorphic_value<T, Options>;
+        static const size_t block_size = 256;
+
+        typename value::destroy_info_cache cache;
+        vector<void*> blocks;
+        while (!values.empty()) {
+            size_t size = values.size() - min(values.size(), block_size);
+            value::destroy_objects(values.begin() + size, values.end(), true, cache, retire != nullptr ? &blocks : nullptr);
+            while (values.size() > size)
+                values.pop_back();      // Unlike erase this does not need move assignment.
+        }
+        free_blocks(std::move(blocks), retire);
+    }
+
+private:
+    // Retire the blocks as one object, so that a clear takes one slot of the reclaimer's ring however many blocks it frees.
+    static void free_blocks(vector<void*> blocks, polymorphic_value_retire_function retire) {
+        if (blocks.empty())
+            return;
+
+        retire(new vector<void*>(std::move(blocks)), [](void* object) {
+            unique_ptr<vector<void*>> blocks(static_cast<vector<void*>*>(object));
+            for (void* block : *blocks)
+                ::operator delete(block);
+        });
+    }
+};
+
+
+// Destroy a range of polymorphic_values, making one virtual call per handler class instead of one per element for trivially
+// destructible Us. The values are left without lifetime: the caller must construct new values in the range, e.g. with
+// construct_at, or release its storage without running the destructors again. To destroy all values of a vector use clear instead.
+template<typename It> void destroy_range(It first, It last) {
+    polymorphic_value_batch_destroy::destroy_range(first, last, nullptr);
+}
+
+// As above, but the heap blocks of trivially destructible Us are freed on the reclaimer thread. Call with
+// polymorphic_value_reclaimer::instance() from polymorphic_value_reclaimer.h.
+template<typename It, typename Reclaimer> void destroy_range(It first, It last, Reclaimer&) {
+    polymorphic_value_batch_destroy::destroy_range(first, last, &polymorphic_value_retire<Reclaimer>);
+}
+
+// Clear a vector of polymorphic_values, see destroy_range.
+template<typename T, polymorphic_value_options Options, typename Allocator>
+void clear(vector<polymorphic_value<T, Options>, Allocator>& values) {
+    polymorphic_value_batch_destroy::clear(values, nullptr);
+}
+template<typename T, polymorphic_value_options Options, typename Allocator, typename Reclaimer>
+void clear(vector<polymorphic_value<T, Options>, Allocator>& values, Reclaimer&) {
+    polymorphic_value_batch_destroy::clear(values, &polymorphic_value_retire<Reclaimer>);
+}
+
+
+}       // Namespace std or stdx
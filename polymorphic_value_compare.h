@@ -0,0 +1,135 @@
+/*
+
+Comparison and hashing of polymorphic_values with the compare, hash and cache_hash options. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <atomic>           // atomic, memory_order_relaxed
+#include <compare>          // partial_ordering, three_way_comparable
+#include <cstddef>          // size_t
+#include <functional>       // hash
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Storage for the hash value of a polymorphic_value with the cache_hash option. 0 means not yet computed. The value is atomic as the
+/// const hash() stores it, so that hash() can be called on the same value from several threads like other const members. Relaxed
+/// loads and stores suffice as each thread computes the same value.
+template<> struct polymorphic_value_hash_cache<true> {
+    polymorphic_value_hash_cache() {}
+    polymorphic_value_hash_cache(const polymorphic_value_hash_cache& src) : m_cached_hash(src.m_cached_hash.load(memory_order_relaxed)) {}
+    polymorphic_value_hash_cache& operator=(const polymorphic_value_hash_cache& src) {
+        m_cached_hash.store(src.m_cached_hash.load(memory_order_relaxed), memory_order_relaxed);
+        return *this;
+    }
+
+    void clear_cached_hash() { m_cached_hash.store(0, memory_order_relaxed); }
+
+    mutable atomic<size_t> m_cached_hash{0};
+};
+
+
+/// Comparison and hashing of polymorphic_values. Objects of different Us are never equal, which is decided by comparing the
+/// handlers, so U's own operators are only called by the handler of U with two objects of type U.
+struct polymorphic_value_comparison {
+    template<typename T, polymorphic_value_options Options>
+    static bool equal(const polymorphic_value<T, Options>& lhs, const polymorphic_value<T, Options>& rhs) {
+        if (!polymorphic_value<T, Options>::same_handler(lhs.m_handler, rhs.m_handler))
+            return false;
+        return std::launder(&lhs.m_handler)->equals(lhs.m_data, rhs.m_data);
+    }
+
+    // Empty values are less than non-empty values, and values of different Us are ordered by handler, which is consistent but
+    // unspecified.
+    template<typename T, polymorphic_value_options Options>
+    static partial_ordering compare(const polymorphic_value<T, Options>& lhs, const polymorphic_value<T, Options>& rhs) {
+        using value = polymorphic_value<T, Options>;
+        if (!value::same_handler(lhs.m_handler, rhs.m_handler)) {
+            bool empty = value::is_empty_handler(lhs.m_handler);
+            bool rhs_empty = value::is_empty_handler(rhs.m_handler);
+            if (empty || rhs_empty)
+                return rhs_empty <=> empty;
+            return value::vtable_of(lhs.m_handler) <=> value::vtable_of(rhs.m_handler);
+        }
+        switch (std::launder(&lhs.m_handler)->compare(lhs.m_data, rhs.m_data)) {
+        case polymorphic_value_order::less: return partial_ordering::less;
+        case polymorphic_value_order::equivalent: return partial_ordering::equivalent;
+        case polymorphic_value_order::greater: return partial_ordering::greater;
+        default: return partial_ordering::unordered;
+        }
+    }
+
+    template<typename T, polymorphic_value_options Options> static size_t hash(const polymorphic_value<T, Options>& value) {
+        if constexpr (Options.cache_hash) {
+            size_t h = value.m_cached_hash.load(memory_order_relaxed);
+            if (h == 0) {
+                h = std::launder(&value.m_handler)->hash(value.m_data);
+                h = h == 0 ? 1 : h;         // 0 means not computed. Still consistent with operator==.
+                value.m_cached_hash.store(h, memory_order_relaxed);
+            }
+            return h;
+        }
+        else
+            return std::launder(&value.m_handler)->hash(value.m_data);
+    }
+
+    // Called by the handler of U.
+    template<typename U> static polymorphic_value_order compare_objects(const U& lhs, const U& rhs) {
+        partial_ordering order = partial_ordering::unordered;
+        if constexpr (three_way_comparable<U>)
+            order = lhs <=> rhs;
+        else if constexpr (requires { lhs < rhs; })
+            order = lhs < rhs ? partial_ordering::less : rhs < lhs ? partial_ordering::greater : partial_ordering::equivalent;
+        else if (lhs == rhs)
+            order = partial_ordering::equivalent;
+
+        if (order < 0)
+            return polymorphic_value_order::less;
+        if (order > 0)
+            return polymorphic_value_order::greater;
+        return order == 0 ? polymorphic_value_order::equivalent : polymorphic_value_order::unordered;
+    }
+    template<typename T, typename U> static size_t hash_object(const U& object) {
+        if constexpr (is_default_constructible_v<std::hash<U>>)
+            return std::hash<U>()(object);
+        else
+            return std::hash<T>()(object);      // Use T's hash if U has none, this is consistent with an inherited operator==.
+    }
+};
+
+
+// Comparison of polymorphic_values with the compare option.
+template<typename T, polymorphic_value_options Options> requires (Options.compare)
+bool operator==(const polymorphic_value<T, Options>& lhs, const polymorphic_value<T, Options>& rhs) {
+    return polymorphic_value_comparison::equal(lhs, rhs);
+}
+template<typename T, polymorphic_value_options Options> requires (Options.compare)
+partial_ordering operator<=>(const polymorphic_value<T, Options>& lhs, const polymorphic_value<T, Options>& rhs) {
+    return polymorphic_value_comparison::compare(lhs, rhs);
+}
+
+
+}       // Namespace std or stdx
+
+
+namespace std {
+
+// Enables use of polymorphic_value as key in unordered containers if the hash or cache_hash option is set.
+template<typename T, STD::polymorphic_value_options Options> requires (Options.hash || Options.cache_hash)
+struct hash<STD::polymorphic_value<T, Options>> {
+    size_t operator()(const STD::polymorphic_value<T, Options>& value) const { return value.hash(); }
+};
+
+}
@@ -0,0 +1,127 @@
+/*
+
+Process wide heap of huge page backed slots for polymorphic_values with the huge_pages option. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <algorithm>        // max
+#include <cstddef>          // size_t, byte
+#include <cstdint>          // uintptr_t
+#include <mutex>            // mutex, lock_guard
+#include <new>              // align_val_t, bad_alloc
+#include <utility>          // exchange
+
+#if defined(__linux__)
+#include <sys/mman.h>       // mmap, munmap, madvise
+#endif
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Process wide heap for the Us of polymorphic_values with the huge_pages option which don't fit the SBO buffer. Objects are carved
+/// out of 2 MB regions which are mapped with mmap and advised to be backed by transparent huge pages, so that a scan over many heap
+/// allocated objects needs few TLB entries, unlike objects scattered over the 4 kB pages of malloc. Slots come in size classes of
+/// multiples of 64 bytes up to 4 kB, and freed slots are reused by objects of the same size class. Regions are never returned to
+/// the operating system. Larger or over-aligned objects, and all objects on other systems than Linux, use the global operator new.
+class polymorphic_value_huge_page_heap {
+public:
+    static const size_t region_size = size_t(2) << 20;
+    static const size_t granularity = 64;
+    static const size_t max_slot_size = 4096;
+
+    static polymorphic_value_huge_page_heap& instance() {
+        // Never destroyed, as objects may be freed by later static destructors.
+        static polymorphic_value_huge_page_heap& heap = *new polymorphic_value_huge_page_heap;
+        return heap;
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        if (!fits_slot(size, alignment))
+            return ::operator new(size, align_val_t(max(alignment, size_t(__STDCPP_DEFAULT_NEW_ALIGNMENT__))));
+
+        size_t c = size_class(size);
+        size_t slot_size = (c + 1) * granularity;
+        lock_guard lock(m_mutex);
+        if (m_free[c] != nullptr)
+            return exchange(m_free[c], m_free[c]->next);
+
+        if (size_t(m_end - m_pos) < slot_size)
+            add_region();
+        return exchange(m_pos, m_pos + slot_size);
+    }
+
+    void deallocate(void* object, size_t size, size_t alignment) {
+        if (!fits_slot(size, alignment)) {
+            ::operator delete(object, align_val_t(max(alignment, size_t(__STDCPP_DEFAULT_NEW_ALIGNMENT__))));
+            return;
+        }
+
+        size_t c = size_class(size);
+        lock_guard lock(m_mutex);
+        m_free[c] = new(object) free_slot{ m_free[c] };
+    }
+
+    // Total size of the regions.
+    size_t bytes_reserved() {
+        lock_guard lock(m_mutex);
+        return m_reserved;
+    }
+
+private:
+    struct free_slot {
+        free_slot* next;
+    };
+
+    polymorphic_value_huge_page_heap() {}
+
+    static bool fits_slot(size_t size, size_t alignment) {
+#if defined(__linux__)
+        return size <= max_slot_size && alignment <= granularity;
+#else
+        return false;
+#endif
+    }
+    static size_t size_class(size_t size) { return (size + granularity - 1) / granularity - 1; }
+
+    // The rest of the previous region, less than max_slot_size, is left unused.
+    void add_region() {
+#if defined(__linux__)
+        // Map twice the size so that a region aligned to a huge page boundary can be kept and the rest unmapped.
+        void* mapping = mmap(nullptr, 2 * region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+            throw bad_alloc();
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+        uintptr_t aligned = (start + region_size - 1) & ~(region_size - 1);
+        if (aligned != start)
+            munmap(mapping, aligned - start);
+        munmap(reinterpret_cast<void*>(aligned + region_size), start + region_size - aligned);
+        madvise(reinterpret_cast<void*>(aligned), region_size, MADV_HUGEPAGE);
+
+        m_pos = reinterpret_cast<byte*>(aligned);
+        m_end = m_pos + region_size;
+        m_reserved += region_size;
+#endif
+    }
+
+    mutex m_mutex;
+    free_slot* m_free[max_slot_size / granularity] = {};
+    byte* m_pos = nullptr;          // Where the next slot is carved out of the current region.
+    byte* m_end = nullptr;
+    size_t m_reserved = 0;
+};
+
+
+}       // Namespace std or stdx
@@ -0,0 +1,159 @@
+/*
+
+Process wide thread destroying objects retired by polymorphic_values with the deferred_destroy option. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <atomic>           // atomic, memory_order_relaxed
+#include <cstddef>          // size_t, ptrdiff_t
+#include <thread>           // thread
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Process wide thread which destroys heap allocated objects retired by polymorphic_values with the deferred_destroy option or by
+/// deferred_destroy(), so that their destructors do not run on latency critical threads. Retired objects are pushed to a bounded
+/// lock-free ring buffer, which is a compare and swap and a store for the retiring thread. If the ring is full the retiring thread
+/// destroys the object itself, which bounds the memory held by retired objects and slows down threads which retire faster than the
+/// reclaimer can keep up with. The reclaimer sleeps while the ring is empty, so only the first retire after that makes a system call.
+///
+/// The thread is started on first use and stopped by a static destructor, objects retired after that are destroyed directly.
+class polymorphic_value_reclaimer {
+public:
+    static const size_t capacity = 4096;
+
+    static polymorphic_value_reclaimer& instance() {
+        // Never destroyed, so polymorphic_values destroyed by later static destructors can still check m_stopped.
+        static polymorphic_value_reclaimer& reclaimer = *new polymorphic_value_reclaimer;
+        static stopper stop;
+        return reclaimer;
+    }
+
+    // Destroy object by calling deleter on the reclaimer thread, or directly if the ring is full or the reclaimer has stopped.
+    void retire(void* object, void (*deleter)(void*)) {
+        if (m_stopped.load(memory_order_relaxed) || !try_push(object, deleter)) {
+            deleter(object);
+            return;
+        }
+
+        // Both the cell and m_sleeping are accessed sequentially consistently by both threads, so either the reclaimer sees the
+        // object before it sleeps or this thread sees that it is sleeping.
+        if (m_sleeping.load() && m_sleeping.exchange(false))
+            m_sleeping.notify_one();
+    }
+
+    // Wait until all objects retired before the call have been destroyed.
+    void flush() {
+        size_t target = m_enqueue_pos.load();
+        wake();
+        size_t reclaimed = m_reclaimed.load(memory_order_acquire);
+        while (reclaimed < target && !m_stopped.load()) {
+            m_reclaimed.wait(reclaimed);
+            reclaimed = m_reclaimed.load(memory_order_acquire);
+        }
+    }
+
+private:
+    struct cell {
+        atomic<size_t> sequence;
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    struct stopper {
+        ~stopper() { instance().stop(); }
+    };
+
+    polymorphic_value_reclaimer() {
+        for (size_t i = 0; i < capacity; i++)
+            m_cells[i].sequence.store(i, memory_order_relaxed);
+        m_thread = thread([this] { run(); });
+    }
+
+    // Bounded queue with multiple producers and one consumer. A cell is free for the producer at position pos when its sequence is
+    // pos and filled for the consumer when it is pos + 1.
+    bool try_push(void* object, void (*deleter)(void*)) {
+        size_t pos = m_enqueue_pos.load(memory_order_relaxed);
+        for (;;) {
+            cell& c = m_cells[pos % capacity];
+            ptrdiff_t diff = ptrdiff_t(c.sequence.load(memory_order_acquire)) - ptrdiff_t(pos);
+            if (diff < 0)
+                return false;       // Full
+            if (diff > 0)
+                pos = m_enqueue_pos.load(memory_order_relaxed);
+            else if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                c.object = object;
+                c.deleter = deleter;
+                c.sequence.store(pos + 1);
+                return true;
+            }
+        }
+    }
+
+    bool try_pop() {
+        cell& c = m_cells[m_dequeue_pos % capacity];
+        if (c.sequence.load(memory_order_acquire) != m_dequeue_pos + 1)
+            return false;
+
+        c.deleter(c.object);
+        c.sequence.store(m_dequeue_pos + capacity, memory_order_release);
+        m_dequeue_pos++;
+        return true;
+    }
+
+    void run() {
+        for (;;) {
+            while (try_pop()) {}
+            m_reclaimed.store(m_dequeue_pos, memory_order_release);
+            m_reclaimed.notify_all();
+            if (m_stopping.load())
+                return;
+
+            m_sleeping.store(true);
+            if (m_cells[m_dequeue_pos % capacity].sequence.load() == m_dequeue_pos + 1 || m_stopping.load())
+                m_sleeping.store(false);
+            else
+                m_sleeping.wait(true);
+        }
+    }
+
+    void wake() {
+        if (m_sleeping.exchange(false))
+            m_sleeping.notify_one();
+    }
+
+    // Objects retired concurrently with stop are destroyed when the retiring thread sees m_stopped or left to the operating system.
+    void stop() {
+        m_stopping.store(true);
+        wake();
+        m_thread.join();
+        m_stopped.store(true);
+        while (try_pop()) {}
+        m_reclaimed.store(m_dequeue_pos, memory_order_release);
+        m_reclaimed.notify_all();
+    }
+
+    cell m_cells[capacity];
+    alignas(64) atomic<size_t> m_enqueue_pos{0};
+    alignas(64) size_t m_dequeue_pos = 0;       // Only accessed by the reclaimer thread until it has stopped.
+    atomic<size_t> m_reclaimed{0};              // Position up to which objects have been destroyed.
+    atomic<bool> m_sleeping{false};
+    atomic<bool> m_stopping{false};
+    atomic<bool> m_stopped{false};
+    thread m_thread;
+};
+
+
+}       // Namespace std or stdx
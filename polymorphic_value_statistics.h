@@ -0,0 +1,109 @@
+/*
+
+Per type counters of polymorphic_values with the statistics option. See README.md for details.
+
+This software is provided under the MIT license, see polymorphic_value.h.
+
+*/
+
+
+
+#pragma once
+
+#include "polymorphic_value.h"
+
+#include <atomic>           // atomic, memory_order_relaxed
+#include <cstddef>          // size_t
+#include <mutex>            // mutex, lock_guard
+
+#if IS_STANDARDIZED
+namespace std {
+#else
+namespace stdx {
+#endif
+
+
+/// Snapshot of the counters of one polymorphic_value type, see polymorphic_value::statistics().
+struct polymorphic_value_statistics {
+    size_t emplaces = 0;
+    size_t copies = 0;
+    size_t moves = 0;
+    size_t destroys = 0;
+    size_t allocations = 0;         // Heap allocations made by emplace or copy of Us that don't fit the SBO buffer.
+    size_t deallocations = 0;
+    size_t allocated_bytes = 0;
+};
+
+
+/// Counter registry of one polymorphic_value type. Each thread increments its own block without any atomic read-modify-write
+/// operations, statistics() aggregates all blocks under the mutex. Blocks of exiting threads are folded into m_retired.
+class polymorphic_value_counters {
+public:
+    // The registry of the polymorphic_value type Value, which is only created when Value counts something.
+    template<typename Value> static polymorphic_value_counters& instance() {
+        static polymorphic_value_counters counters;
+        return counters;
+    }
+
+    // Add n to a counter in the calling thread's block for Value. Only the owning thread writes, so a relaxed load and store is
+    // enough and avoids a locked add.
+    template<typename Value> static void count(polymorphic_value_counter counter, size_t n) {
+        thread_local block b(instance<Value>());
+        atomic<size_t>& c = b.m_counts[size_t(counter)];
+        c.store(c.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    polymorphic_value_statistics snapshot() {
+        lock_guard lock(m_mutex);
+        polymorphic_value_statistics ret = m_retired;
+        for (block* b = m_blocks; b != nullptr; b = b->m_next)
+            accumulate(ret, *b);
+        return ret;
+    }
+
+private:
+    struct block {
+        explicit block(polymorphic_value_counters& owner) : m_owner(owner) { m_owner.attach(*this); }
+        ~block() { m_owner.detach(*this); }
+
+        size_t load(polymorphic_value_counter counter) const { return m_counts[size_t(counter)].load(memory_order_relaxed); }
+
+        atomic<size_t> m_counts[size_t(polymorphic_value_counter::allocated_bytes) + 1] = {};
+        polymorphic_value_counters& m_owner;
+        block* m_next = nullptr;
+    };
+
+    static void accumulate(polymorphic_value_statistics& dest, const block& src) {
+        using enum polymorphic_value_counter;
+        dest.emplaces += src.load(emplaces);
+        dest.copies += src.load(copies);
+        dest.moves += src.load(moves);
+        dest.destroys += src.load(destroys);
+        dest.allocations += src.load(allocations);
+        dest.deallocations += src.load(deallocations);
+        dest.allocated_bytes += src.load(allocated_bytes);
+    }
+
+    void attach(block& b) {
+        lock_guard lock(m_mutex);
+        b.m_next = m_blocks;
+        m_blocks = &b;
+    }
+    void detach(block& b) {
+        lock_guard lock(m_mutex);
+        accumulate(m_retired, b);
+        for (block** p = &m_blocks; *p != nullptr; p = &(*p)->m_next) {
+            if (*p == &b) {
+                *p = b.m_next;
+                break;
+            }
+        }
+    }
+
+    mutex m_mutex;
+    block* m_blocks = nullptr;
+    polymorphic_value_statistics m_retired;
+};
+
+
+}       // Namespace std or stdx
@@ -3,6 +3,7 @@ import sys
 import os
 import platform
 import subprocess
+import time
 
 
 def check_for_executable(exe_name, args=["--version"]):
@@ -15,6 +16,36 @@ def check_for_executable(exe_name, args=["--version"]):
         return False
 
 
+def time_target(src_dir, args, target):
+    """Build target, then remove its object files and time a rebuild, which excludes generating the sources."""
+    subprocess.check_call("cmake --build {} --target {}".format(args.out_dir, target).split(), cwd=src_dir)
+    object_dir = os.path.join(src_dir, args.out_dir, "bench", "CMakeFiles", target + ".dir")
+    for root, dirs, files in os.walk(object_dir):
+        for f in files:
+            if f.endswith((".o", ".obj")):
+                os.remove(os.path.join(root, f))
+    start = time.time()
+    subprocess.check_call("cmake --build {} --target {}".format(args.out_dir, target).split(), cwd=src_dir)
+    return time.time() - start
+
+
+def compile_bench(src_dir, args):
+    bench_dir = os.path.join(src_dir, args.out_dir, "bench")
+    results = []
+    for count in (10, 100, 1000):
+        results.append(("{} subclasses".format(count), time_target(src_dir, args, "bench_compile_{}".format(count))))
+
+    for mode in ("include", "import"):
+        target = "bench_{}_500".format(mode)
+        if os.path.isdir(os.path.join(bench_dir, "CMakeFiles", target + ".dir")):
+            results.append(("500 TUs ({})".format(mode), time_target(src_dir, args, target)))
+
+    print("Compile times:")
+    for name, seconds in results:
+        print("  {:>20}: {:6.2f} s".format(name, seconds))
+    print("Time traces (Clang only) are in {}".format(bench_dir))
+
+
 def main():
     import argparse
 
@@ -50,6 +81,19 @@ def main():
         dest="sanitizers",
     )
 
+    parser.add_argument(
+        "--compile-bench",
+        help="build the benchmarks and time compilation of 10, 100 and 1000 generated subclasses",
+        action="store_true",
+        dest="compile_bench",
+    )
+    parser.add_argument(
+        "--module",
+        help="build the stdx.polymorphic_value module (GCC only), --compile-bench then also times importing it",
+        action="store_true",
+        dest="module",
+    )
+
     if platform.system() == "Windows":
         parser.add_argument(
             "--win32", help="Build 32-bit libraries", action="store_true", dest="win32"
@@ -81,11 +125,20 @@ def main():
     if args.sanitizers:
         cmake_invocation.append("-DENABLE_SANITIZERS:BOOL=ON")
 
+    if args.compile_bench:
+        cmake_invocation.append("-DPOLYMORPHIC_VALUE_BENCHMARKS:BOOL=ON")
+
+    if args.module:
+        cmake_invocation.append("-DPOLYMORPHIC_VALUE_MODULE:BOOL=ON")
+
     subprocess.check_call(cmake_invocation, cwd=src_dir)
     subprocess.check_call(
         "cmake --build ./{}".format(args.out_dir).split(), cwd=src_dir
     )
 
+    if args.compile_bench:
+        compile_bench(src_dir, args)
+
     if args.run_tests:
         rc = subprocess.call(
             "ctest . --output-on-failure -C {}".format(args.config).split(),
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Check the machine code of the functions in a codegen test source against the budgets given in its comments.
+
+Each checked function is declared extern "C" and preceded by a comment line of the form
+
+    // codegen-budget: instructions=<n> indirect=<n>
+
+The object file compiled from the source is disassembled with objdump and the number of instructions (not counting alignment
+padding) and the number of indirect calls and jumps of each function must not exceed the budget.
+"""
+import re
+import subprocess
+import sys
+
+
+BUDGET_RE = re.compile(r"//\s*codegen-budget:\s*instructions=(\d+)\s+indirect=(\d+)")
+FUNCTION_RE = re.compile(r'extern\s+"C"\s+[\w:*&<> ]+?\b(\w+)\s*\(')
+LABEL_RE = re.compile(r"^[0-9a-f]+ <(\w+)>:$")
+INSTRUCTION_RE = re.compile(r"^\s*[0-9a-f]+:\s+(\S+)\s*(.*)$")
+# Alignment padding as printed by objdump: the nop forms, optionally with data16 and cs prefixes, and xchg %ax,%ax, which is the
+# two byte nop. Other xchg instructions do real work and are counted.
+PADDING_RE = re.compile(r"^((data16|cs)\s+)*(nop[wl]?(\s+\S+)?|xchg\s+%ax,%ax)$")
+
+
+def read_budgets(source):
+    budgets = {}
+    pending = None
+    with open(source) as f:
+        for line in f:
+            m = BUDGET_RE.search(line)
+            if m:
+                pending = (int(m.group(1)), int(m.group(2)))
+                continue
+            m = FUNCTION_RE.search(line)
+            if m and pending:
+                budgets[m.group(1)] = pending
+                pending = None
+    return budgets
+
+
+def disassemble(objdump, obj):
+    functions = {}
+    current = None
+    out = subprocess.check_output([objdump, "-d", "--no-show-raw-insn", obj], universal_newlines=True)
+    for line in out.splitlines():
+        m = LABEL_RE.match(line)
+        if m:
+            current = functions.setdefault(m.group(1), [])
+            continue
+        m = INSTRUCTION_RE.match(line)
+        if m and current is not None:
+            current.append((m.group(1), m.group(2)))
+        elif not line.strip():
+            current = None
+    return functions
+
+
+def is_padding(mnemonic, operands):
+    return PADDING_RE.match((mnemonic + " " + operands).strip()) is not None
+
+
+def is_indirect(mnemonic, operands):
+    if mnemonic.startswith(("call", "jmp")):
+        return operands.startswith("*")
+    return mnemonic in ("blr", "br")         # aarch64
+
+
+def main():
+    if len(sys.argv) != 4:
+        print("usage: check_codegen.py <objdump> <source> <object file>")
+        return 2
+
+    objdump, source, obj = sys.argv[1:]
+    budgets = read_budgets(source)
+    functions = disassemble(objdump, obj)
+
+    failed = False
+    for name, (max_instructions, max_indirect) in sorted(budgets.items()):
+        if name not in functions:
+            print("{}: not found in {}".format(name, obj))
+            failed = True
+            continue
+
+        code = [(m, o) for m, o in functions[name] if not is_padding(m, o)]
+        instructions = len(code)
+        indirect = sum(1 for m, o in code if is_indirect(m, o))
+        ok = instructions <= max_instructions and indirect <= max_indirect
+        print("{}: {} {} instructions (budget {}), {} indirect (budget {})".format(
+            "ok  " if ok else "FAIL", name, instructions, max_instructions, indirect, max_indirect))
+        failed = failed or not ok
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,22 @@
+# Checks that the USDT probe notes of polymorphic_value.h are present in BINARY.
+# Usage: cmake -DREADELF=<readelf> -DBINARY=<executable> -P check_usdt_probes.cmake
+
+execute_process(
+    COMMAND ${READELF} --notes ${BINARY}
+    OUTPUT_VARIABLE notes
+    RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${READELF} failed on ${BINARY}")
+endif()
+
+if(NOT notes MATCHES "Provider: polymorphic_value")
+    message(FATAL_ERROR "No polymorphic_value probes found in ${BINARY}")
+endif()
+
+foreach(probe heap_alloc deep_copy type_change copy_failed)
+    if(NOT notes MATCHES "Name: ${probe}\n")
+        message(FATAL_ERROR "Probe polymorphic_value:${probe} is missing in ${BINARY}")
+    endif()
+    message(STATUS "Found probe polymorphic_value:${probe}")
+endforeach()
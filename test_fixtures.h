@@ -0,0 +1,36 @@
+// Subclasses shared by the container tests. Each is a template over the base class of the container under test, so each test gets
+// its own live count.
+
+#pragma once
+
+#include <stdexcept>
+
+// Counts the live objects, to check that a container destroys each object exactly once.
+template<typename Base> struct Counted : public Base {
+    Counted() { live++; }
+    Counted(const Counted&) { live++; }
+    Counted(Counted&&) { live++; }
+    ~Counted() { live--; }
+    static inline int live = 0;
+};
+
+// Always throws when copied, and also when constructed while fail is set, to check what a container leaves behind when a
+// constructor throws part way through an operation.
+template<typename Base> struct Throwing : public Base {
+    Throwing() { if (fail) throw std::runtime_error("Throwing"); }
+    Throwing(const Throwing&) { throw std::runtime_error("Throwing"); }
+    Throwing(Throwing&&) {}
+    static inline bool fail = false;
+};
+
+// Returns true if f() throws an E.
+template<typename E = std::runtime_error, typename F> bool throws(F&& f)
+{
+    try {
+        f();
+    }
+    catch (const E&) {
+        return true;
+    }
+    return false;
+}
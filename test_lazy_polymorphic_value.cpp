@@ -0,0 +1,118 @@
+#include "lazy_polymorphic_value.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+static std::atomic<int> decodes = 0;
+
+struct Shape {
+    virtual ~Shape() {}
+    virtual float area() const { return 0; }
+};
+
+// Decoded by add<Circle>, which uses the constructor from bytes.
+struct Circle : public Shape {
+    Circle(std::span<const std::byte> bytes) {
+        std::memcpy(&radius, bytes.data(), sizeof(radius));
+        decodes++;
+    }
+    float area() const override { return 3 * radius * radius; }
+    float radius;
+};
+
+struct Rectangle : public Shape {
+    Rectangle(float w, float h) : w(w), h(h) { decodes++; }
+    float area() const override { return w * h; }
+    float w, h;
+};
+
+using Registry = polymorphic_type_registry<Shape>;
+using LazyShape = lazy_polymorphic_value<Shape>;
+
+template<typename... Fs> static std::vector<std::byte> encode(Fs... fs)
+{
+    std::vector<std::byte> ret(sizeof(float) * sizeof...(Fs));
+    float values[] = { fs... };
+    std::memcpy(ret.data(), values, ret.size());
+    return ret;
+}
+
+int main()
+{
+    Registry registry;
+    registry.add<Circle>(1);
+    registry.add(2, [](Registry::value_type& dest, std::span<const std::byte> bytes) {
+        float values[2];
+        std::memcpy(values, bytes.data(), sizeof(values));
+        dest.emplace<Rectangle>(values[0], values[1]);
+    });
+    assert(registry.contains(1) && registry.contains(2) && !registry.contains(0) && !registry.contains(7));
+
+    std::vector<std::byte> circle_bytes = encode(2.0f);
+    std::vector<std::byte> rectangle_bytes = encode(2.0f, 3.0f);
+
+    // Decoding happens on first access only.
+    LazyShape circle(registry, 1, circle_bytes);
+    LazyShape rectangle(registry, 2, rectangle_bytes);
+    assert(circle && !circle.decoded() && decodes == 0);
+    assert(circle->area() == 12 && circle.decoded() && decodes == 1);
+    assert(circle->area() == 12 && decodes == 1);
+    assert(rectangle.value()->area() == 6 && decodes == 2);
+
+    // Copies of undecoded values decode separately, copies of decoded values copy the object.
+    LazyShape undecoded(registry, 1, circle_bytes);
+    LazyShape copy = undecoded;
+    assert(!copy.decoded() && (*copy).area() == 12 && decodes == 3);
+    LazyShape decoded_copy = circle;
+    assert(decoded_copy.decoded() && decoded_copy->area() == 12 && decodes == 3);
+    copy = undecoded;
+    assert(!copy.decoded());
+    copy = std::move(rectangle);
+    assert(copy.decoded() && copy->area() == 6);
+
+    LazyShape empty;
+    assert(!empty && empty.decoded() && empty.get() == nullptr);
+    LazyShape wrapped(Registry::value_type::make<Rectangle>(1.0f, 4.0f));
+    assert(wrapped.decoded() && wrapped->area() == 4);
+
+    // Const access doesn't advance the generation of the decoded value, so concurrent readers don't write to it.
+    polymorphic_type_registry<Shape, polymorphic_value_options{ .generation = true }> generation_registry;
+    generation_registry.add<Circle>(1);
+    const lazy_polymorphic_value<Shape, polymorphic_value_options{ .generation = true }> tracked(generation_registry, 1, circle_bytes);
+    uint64_t generation = tracked.value().generation();
+    assert(tracked->area() == 12 && tracked.get()->area() == 12 && (*tracked).area() == 12);
+    assert(tracked.value().generation() == generation);
+
+    // Concurrent first accesses decode once.
+    decodes = 0;
+    LazyShape shared(registry, 1, circle_bytes);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+        threads.emplace_back([&] { assert(shared->area() == 12); });
+    for (auto& t : threads)
+        t.join();
+    assert(decodes == 1);
+
+    // An unknown type id throws on access, and the next access tries again.
+    LazyShape later(registry, 3, circle_bytes);
+    bool thrown = false;
+    try {
+        later.get();
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown && !later.decoded());
+    registry.add<Circle>(3);
+    assert(later->area() == 12);
+}
@@ -0,0 +1,152 @@
+#include "polymorphic_arena.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+struct Node;
+using Ast = polymorphic_arena<Node, polymorphic_value_options{}, 4096>;
+
+struct Node {
+    virtual ~Node() {}
+    virtual int evaluate(const Ast& ast) const { return 0; }
+    virtual void for_each_child(polymorphic_arena_visitor& visitor) {}
+};
+
+struct Literal : public Node {
+    Literal(int value) : value(value) {}
+    int evaluate(const Ast&) const override { return value; }
+    int value;
+};
+
+struct Add : public Node {
+    Add(polymorphic_arena_handle<Node> lhs, polymorphic_arena_handle<Node> rhs) : lhs(lhs), rhs(rhs) {}
+    int evaluate(const Ast& ast) const override { return ast[lhs].evaluate(ast) + ast[rhs].evaluate(ast); }
+    void for_each_child(polymorphic_arena_visitor& visitor) override { visitor(lhs); visitor(rhs); }
+    polymorphic_arena_handle<Node> lhs, rhs;
+};
+
+struct Call : public Node {
+    Call(std::string name) : name(std::move(name)) {}
+    int evaluate(const Ast& ast) const override {
+        int sum = 0;
+        for (auto arg : args)
+            sum += ast[arg].evaluate(ast);
+        return sum;
+    }
+    void for_each_child(polymorphic_arena_visitor& visitor) override {
+        for (auto& arg : args)
+            visitor(arg);
+    }
+    std::string name;
+    std::vector<polymorphic_arena_handle<Node>> args;
+};
+
+struct Blob : public Node {
+    char data[5000] = {};           // Larger than a chunk.
+};
+
+using CountedNode = Counted<Node>;
+using ThrowingNode = Throwing<Node>;
+
+static_assert(sizeof(Ast::handle<Add>) == 4);
+
+
+int main()
+{
+    Ast ast;
+    assert(ast.empty() && ast.get(polymorphic_arena_handle<Node>()) == nullptr);
+
+    auto one = ast.emplace<Literal>(1);
+    auto two = ast.emplace<Literal>(2);
+    auto sum = ast.emplace<Add>(one, two);
+    assert(ast[one].value == 1);                // Typed handles give the U without a cast.
+    assert(ast[sum].evaluate(ast) == 3);
+    polymorphic_arena_handle<Node> root = sum;  // Converts to a handle of a base class.
+    assert(ast[root].evaluate(ast) == 3);
+
+    auto call = ast.emplace<Call>("f");
+    ast[call].args = { sum, ast.emplace<Literal>(10) };
+    assert(ast[call].evaluate(ast) == 13 && ast.size() == 5);
+
+    // Visit in pre-order
+    std::vector<int> order;
+    ast.visit(call, [&](Node& node, polymorphic_arena_handle<> h) { order.push_back(node.evaluate(ast)); });
+    assert((order == std::vector<int>{ 13, 3, 1, 2, 10 }));
+
+    // Deep clone creates new nodes, the original is unchanged.
+    auto copy = ast.clone(call);
+    assert(copy != call && ast.size() == 10);
+    assert(ast[copy].evaluate(ast) == 13 && ast[copy].name == "f");
+    ast.get(ast[copy].args[1])->~Node();        // Not allowed in general, but proves the copies are separate objects.
+    new(ast.get(ast[copy].args[1])) Literal(20);
+    assert(ast[copy].evaluate(ast) == 23 && ast[call].evaluate(ast) == 13);
+    assert(ast[copy].args[0] != sum && ast[ast[copy].args[0]].evaluate(ast) == 3);
+
+    // A large tree over many chunks stays compact. A polymorphic_value<Node> per edge would take 72 bytes.
+    Ast big;
+    auto list = big.emplace<Literal>(0);
+    polymorphic_arena_handle<Node> tail = list;
+    for (int i = 1; i <= 10000; i++)
+        tail = big.emplace<Add>(tail, big.emplace<Literal>(i));
+    assert(big[tail].evaluate(big) == 10000 * 10001 / 2);
+    assert(big.size() == 20001 && big.bytes_used() < 20001 * sizeof(polymorphic_value<Node>) / 2);
+    size_t count = 0;
+    big.for_each([&](Node&) { count++; });
+    assert(count == 20001);
+
+    // Deep trees are cloned and visited without recursion.
+    auto big_copy = big.clone(tail);
+    assert(big[big_copy].evaluate(big) == 10000 * 10001 / 2 && big.size() == 40002);
+    count = 0;
+    big.visit(big_copy, [&](Node&, polymorphic_arena_handle<>) { count++; });
+    assert(count == 20001);
+
+    // Oversized objects get a chunk of their own. Copies of the arena have the same handles.
+    auto blob = big.emplace<Blob>();
+    auto after = big.emplace<Literal>(5);
+    Ast big2 = big;
+    assert(big2[after].value == 5 && big2[tail].evaluate(big2) == 10000 * 10001 / 2);
+    assert(&big2[blob] != &big[blob]);
+    Ast big3 = std::move(big2);
+    assert(big2.empty() && big3[after].value == 5);
+
+    // Bulk destruction destroys each object once.
+    {
+        Ast counted;
+        for (int i = 0; i < 1000; i++)
+            counted.emplace<CountedNode>();
+        Ast counted2 = counted;
+        assert(CountedNode::live == 2000);
+        counted.clear();
+        assert(CountedNode::live == 1000 && counted.empty());
+
+        // A throwing emplace takes no room, the next object gets the handle the failed one would have had.
+        auto first = counted.emplace<Literal>(0);
+        counted.clear();
+        ThrowingNode::fail = true;
+        assert(throws([&] { counted.emplace<ThrowingNode>(); }) && counted.empty());
+        ThrowingNode::fail = false;
+        assert(counted.emplace<ThrowingNode>().bits() == first.bits());
+
+        // A throwing copy of the arena destroys the objects copied before it. A throwing clone leaves the nodes it copied before
+        // in the arena, and they are destroyed with it.
+        counted2.emplace<ThrowingNode>();
+        assert(throws([&] { Ast counted3 = counted2; }) && CountedNode::live == 1000);
+        auto call = counted2.emplace<Call>("g");
+        counted2[call].args = { counted2.emplace<CountedNode>(), counted2.emplace<ThrowingNode>() };
+        size_t before = counted2.size();
+        assert(throws([&] { counted2.clone(call); }) && counted2.size() == before + 2 && CountedNode::live == 1002);
+    }
+    assert(CountedNode::live == 0);
+
+    std::cout << "polymorphic_arena ok" << std::endl;
+}
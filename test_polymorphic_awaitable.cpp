@@ -0,0 +1,126 @@
+#include "polymorphic_awaitable.h"
+#include "polymorphic_value_statistics.h"
+
+#include <cassert>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <iostream>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+// Coroutines which are resumed by the test after they have suspended in a Queued awaiter.
+static std::deque<std::coroutine_handle<>> ready_queue;
+
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(const Task&) = delete;
+    ~Task() { handle.destroy(); }
+
+    bool done() const { return handle.done(); }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// One awaiter for each form of await_suspend.
+struct Ready {
+    bool await_ready() { return true; }
+    void await_suspend(std::coroutine_handle<>) {}
+    int await_resume() { return value; }
+    int value;
+};
+
+struct Queued {
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) { ready_queue.push_back(h); }
+    int await_resume() { return value; }
+    int value;
+};
+
+struct Refused {
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<>) { return false; }
+    int await_resume() { return value; }
+    int value;
+};
+
+struct Transfer {
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) { return h; }
+    int await_resume() { return value; }
+    int value;
+};
+
+struct BigAwaiter {
+    bool await_ready() { return true; }
+    void await_suspend(std::coroutine_handle<>) {}
+    int await_resume() { return payload[99]; }
+    int payload[100] = {};
+};
+
+using Operation = polymorphic_awaitable<int, polymorphic_value_options{ .copy = false, .statistics = true }>;
+
+static Operation make_operation(int kind, int value)
+{
+    switch (kind) {
+    case 0:
+        return Ready{ value };
+    case 1:
+        return Queued{ value };
+    case 2:
+        return Refused{ value };
+    default:
+        return Operation(std::in_place_type<Transfer>, value);
+    }
+}
+
+static Task run(int& total, int count)
+{
+    for (int i = 0; i < count; i++)
+        total += co_await make_operation(i % 4, i);
+}
+
+int main()
+{
+    int total = 0;
+    {
+        Task task = run(total, 100);
+        assert(!task.done() && ready_queue.size() == 1);
+        while (!ready_queue.empty()) {
+            std::coroutine_handle<> h = ready_queue.front();
+            ready_queue.pop_front();
+            h.resume();
+        }
+        assert(task.done());
+    }
+    assert(total == 99 * 100 / 2);
+
+    polymorphic_value_statistics stats = Operation::value_type::statistics();
+    assert(stats.emplaces == 100 && stats.allocations == 0);
+
+    // An awaiter which does not fit the SBO buffer is allocated.
+    Operation big;
+    assert(!big);
+    big.emplace<BigAwaiter>().payload[99] = 7;
+    assert(big && big.await_ready() && big.await_resume() == 7);
+    assert(Operation::value_type::statistics().allocations == 1);
+
+    Operation moved = std::move(big);
+    assert(moved.await_resume() == 7);
+    moved.reset();
+    assert(!moved);
+
+    std::cout << "polymorphic_awaitable ok" << std::endl;
+}
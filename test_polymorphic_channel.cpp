@@ -0,0 +1,121 @@
+#include "polymorphic_channel.h"
+#include "polymorphic_value_statistics.h"
+
+#include <cassert>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+struct Msg {
+    virtual ~Msg() {}
+    virtual int weight() const { return 0; }
+};
+
+struct Ping : public Msg {
+    Ping(int n) : n(n) {}
+    int weight() const override { return n; }
+    int n;
+};
+
+struct Text : public Msg {
+    Text(std::string s) : s(std::move(s)) {}
+    int weight() const override { return int(s.size()); }
+    std::string s;
+};
+
+// Single threaded event loop which resumes the coroutines the channel schedules.
+struct EventLoop : public polymorphic_channel_scheduler {
+    void schedule(std::coroutine_handle<> h) override { ready.push_back(h); }
+    void run() {
+        while (!ready.empty()) {
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            h.resume();
+        }
+    }
+    std::deque<std::coroutine_handle<>> ready;
+};
+
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return Task{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(const Task&) = delete;
+    ~Task() { handle.destroy(); }
+
+    bool done() const { return handle.done(); }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+using Channel = polymorphic_channel<Msg, 4, polymorphic_value_options{ .statistics = true }>;
+
+static Task produce(Channel& channel, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (i % 2 == 0)
+            co_await channel.send<Ping>(i);
+        else
+            co_await channel.send<Text>(std::string(i % 7, 'x'));
+    }
+}
+
+static Task consume(Channel& channel, int count, int& total, bool& ordered)
+{
+    for (int i = 0; i < count; i++) {
+        Channel::value_type m = co_await channel.receive();
+        int expected = i % 2 == 0 ? i : i % 7;
+        ordered = ordered && m->weight() == expected;
+        total += m->weight();
+    }
+}
+
+int main()
+{
+    EventLoop loop;
+    Channel channel(loop);
+
+    // The producer fills the ring and suspends until the consumer makes room.
+    {
+        int total = 0;
+        bool ordered = true;
+        Task producer = produce(channel, 100);
+        assert(!producer.done() && channel.full());
+        Task consumer = consume(channel, 100, total, ordered);
+        loop.run();
+        assert(producer.done() && consumer.done() && channel.empty());
+        assert(ordered && total == 2450 + 148);
+    }
+
+    // Receivers wait for senders as well.
+    {
+        int total = 0;
+        bool ordered = true;
+        Task consumer = consume(channel, 10, total, ordered);
+        Task consumer2 = consume(channel, 10, total, ordered);
+        assert(!consumer.done() && channel.empty());
+        Task producer = produce(channel, 20);
+        loop.run();
+        assert(producer.done() && consumer.done() && consumer2.done());
+        assert(total == 90 + 1 + 3 + 5 + 0 + 2 + 4 + 6 + 1 + 3 + 5);
+    }
+
+    polymorphic_value_statistics stats = Channel::value_type::statistics();
+    assert(stats.emplaces == 120 && stats.allocations == 0);
+
+    std::cout << "polymorphic_channel ok" << std::endl;
+}
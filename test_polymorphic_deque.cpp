@@ -0,0 +1,120 @@
+#include "polymorphic_deque.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+struct Event {
+    virtual ~Event() {}
+    virtual int kind() const { return 0; }
+};
+
+struct Tick : public Event {
+    Tick(int n) : n(n) {}
+    int kind() const override { return 1; }
+    int n;
+};
+
+struct Message : public Event {
+    Message(std::string text) : text(std::move(text)) {}
+    int kind() const override { return 2; }
+    std::string text;
+};
+
+struct alignas(32) Aligned : public Event {
+    int kind() const override { return 3; }
+    double values[4] = {};
+};
+
+struct Huge : public Event {
+    int kind() const override { return 4; }
+    char data[10000] = {};          // Larger than a chunk.
+};
+
+using CountedEvent = Counted<Event>;
+using ThrowingEvent = Throwing<Event>;
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+using EventQueue = polymorphic_deque<Event, polymorphic_value_options{ .alignment = 32 }, 1024>;
+
+
+int main()
+{
+    EventQueue events;
+    assert(events.empty() && events.begin() == events.end());
+
+    Tick& first = events.emplace_back<Tick>(1);
+    events.emplace_back<Message>("hello");
+    events.emplace_back<Aligned>();
+    events.push_back(Tick(2));
+    assert(events.size() == 4);
+    assert(events.front().kind() == 1 && events.back().kind() == 1 && &events.front() == &first);
+
+    int kinds[] = { 1, 2, 3, 1 };
+    int i = 0;
+    for (Event& e : events) {
+        assert(e.kind() == kinds[i++]);
+        if (e.kind() == 3)
+            assert(reinterpret_cast<uintptr_t>(&e) % 32 == 0);
+    }
+    assert(i == 4);
+
+    // Elements are not moved when chunks are added.
+    for (int n = 0; n < 1000; n++)
+        events.emplace_back<Tick>(n);
+    events.emplace_back<Huge>();
+    assert(&events.front() == &first && events.size() == 1005 && events.back().kind() == 4);
+
+    events.pop_front();
+    assert(events.front().kind() == 2 && static_cast<Message&>(events.front()).text == "hello");
+    events.pop_front();
+    events.pop_front();
+    events.pop_front();
+    for (int n = 0; n < 1000; n++) {
+        assert(static_cast<Tick&>(events.front()).n == n);
+        events.pop_front();
+    }
+    assert(events.size() == 1 && events.front().kind() == 4);
+
+    // Copy and move
+    events.emplace_back<Message>("copied");
+    auto copy = events;
+    assert(copy.size() == 2 && static_cast<Message&>(copy.back()).text == "copied");
+    auto moved = std::move(copy);
+    assert(copy.empty() && moved.size() == 2 && moved.front().kind() == 4);
+    events.clear();
+    assert(events.empty() && events.begin() == events.end());
+
+    // Steady state operation reuses chunks, and each object is destroyed exactly once, also by move assignment.
+    {
+        polymorphic_deque<Event, polymorphic_value_options{}, 256> counted;
+        for (int round = 0; round < 10; round++) {
+            for (int n = 0; n < 100; n++)
+                counted.emplace_back<CountedEvent>();
+            for (int n = 0; n < 90; n++)
+                counted.pop_front();
+        }
+        assert(CountedEvent::live == 100 && counted.size() == 100);
+        auto counted2 = counted;
+        assert(CountedEvent::live == 200);
+        counted2 = std::move(counted);
+        assert(CountedEvent::live == 100 && counted.empty() && counted2.size() == 100);
+        counted = counted2;
+        assert(CountedEvent::live == 200);
+
+        // A copy which throws many chunks in destroys the elements copied before and frees their chunks. The source is unchanged.
+        counted.emplace_back<ThrowingEvent>();
+        assert(throws([&] { auto counted3 = counted; }) && CountedEvent::live == 200);
+        counted.pop_front();
+        assert(CountedEvent::live == 199 && counted.size() == 100 && counted.back().kind() == 0);
+    }
+    assert(CountedEvent::live == 0);
+
+    std::cout << "polymorphic_deque ok" << std::endl;
+}
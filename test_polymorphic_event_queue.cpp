@@ -0,0 +1,146 @@
+#include "polymorphic_event_queue.h"
+#include "polymorphic_value_statistics.h"
+#include "test_fixtures.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+struct Event {
+    virtual ~Event() {}
+    virtual int id() const { return -1; }
+};
+
+struct Arrival : public Event {
+    Arrival(int n) : n(n) {}
+    int id() const override { return n; }
+    int n;
+};
+
+struct Departure : public Event {
+    Departure(int n) : n(n) {}
+    int id() const override { return n; }
+    int n;
+    double payload[4] = {};
+};
+
+using CountedEvent = Counted<Event>;
+using ThrowingEvent = Throwing<Event>;
+
+// Makes the next allocations fail, to check schedule when a bucket can't grow.
+static bool fail_allocations = false;
+
+void* operator new(size_t size)
+{
+    void* p = fail_allocations ? nullptr : std::malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+using Queue = polymorphic_event_queue<Event, polymorphic_value_options{ .statistics = true }, 16>;
+
+int main()
+{
+    // Events come out in time order, also when scheduled during dispatch.
+    Queue queue;
+    std::mt19937_64 random(1);
+    std::vector<uint64_t> times;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t = random() % 100000;
+        times.push_back(t);
+        if (i % 2 == 0)
+            queue.schedule<Arrival>(t, i);
+        else
+            queue.schedule<Departure>(t, i);
+    }
+    assert(queue.size() == 1000);
+    std::sort(times.begin(), times.end());
+    assert(queue.next_time() == times.front());
+
+    std::vector<uint64_t> dispatched;
+    int follow_ups = 0;
+    while (queue.dispatch([&](Event& e) {
+        dispatched.push_back(queue.now());
+        if (e.id() % 10 == 0 && e.id() >= 0) {
+            queue.schedule<Arrival>(queue.now() + 50, -1);
+            follow_ups++;
+        }
+    })) {}
+    assert(queue.empty() && dispatched.size() == 1000 + size_t(follow_ups));
+    assert(std::is_sorted(dispatched.begin(), dispatched.end()));
+
+    // Events are constructed in place and never moved.
+    polymorphic_value_statistics stats = Queue::value_type::statistics();
+    assert(stats.emplaces == 1000 + size_t(follow_ups) && stats.moves == 0 && stats.copies == 0);
+
+    // Scheduling before now() is an error.
+    bool thrown = false;
+    try {
+        queue.schedule<Arrival>(queue.now() - 1, 0);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // Events are destroyed after dispatch, by an exception from the handler and by clear.
+    for (int i = 0; i < 40; i++)
+        queue.schedule<CountedEvent>(queue.now() + i);
+    assert(CountedEvent::live == 40);
+    queue.dispatch([](Event&) {});
+    assert(CountedEvent::live == 39);
+    thrown = false;
+    try {
+        queue.dispatch([](Event&) { throw std::runtime_error("handler"); });
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && CountedEvent::live == 38 && queue.size() == 38);
+    queue.clear();
+    assert(CountedEvent::live == 0 && queue.empty() && !queue.dispatch([](Event&) {}));
+
+    // An event whose constructor throws, or which can't be added to its bucket, is not scheduled and its slot is freed.
+    {
+        Queue failing;
+        failing.schedule<Arrival>(0, 1);
+        ThrowingEvent::fail = true;
+        assert(throws([&] { failing.schedule<ThrowingEvent>(0); }));
+        ThrowingEvent::fail = false;
+        fail_allocations = true;
+        thrown = throws<std::bad_alloc>([&] { failing.schedule<CountedEvent>(0); });
+        fail_allocations = false;
+        assert(thrown && failing.size() == 1 && CountedEvent::live == 0);
+        for (int i = 0; i < 15; i++)
+            failing.schedule<CountedEvent>(i);
+        assert(failing.size() == 16 && CountedEvent::live == 15);
+        failing.clear();
+        assert(CountedEvent::live == 0);
+    }
+
+    // next_time doesn't move now(), so an earlier event can still be scheduled after it.
+    uint64_t start = queue.now();
+    queue.schedule<Arrival>(start + 100, 1);
+    assert(queue.next_time() == start + 100 && queue.now() == start);
+    queue.schedule<Arrival>(start + 50, 2);
+    assert(queue.next_time() == start + 50);
+    std::vector<int> order;
+    while (queue.dispatch([&](Event& e) { order.push_back(e.id()); })) {}
+    assert(order == std::vector<int>({ 2, 1 }) && queue.now() == start + 100);
+
+    std::cout << "polymorphic_event_queue ok" << std::endl;
+}
@@ -0,0 +1,126 @@
+#include "polymorphic_flat_map.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+struct Symbol {
+    virtual ~Symbol() {}
+    virtual int kind() const { return 0; }
+};
+
+struct Variable : public Symbol {
+    Variable(int slot) : slot(slot) {}
+    int kind() const override { return 1; }
+    int slot;
+};
+
+struct Function : public Symbol {
+    int kind() const override { return 2; }
+    char body[200] = {};            // Too large for the SBO buffer.
+};
+
+using CountedSymbol = Counted<Symbol>;
+using ThrowingSymbol = Throwing<Symbol>;
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+
+int main()
+{
+    polymorphic_flat_map<std::string, Symbol> symbols;
+    assert(symbols.empty() && symbols.find("x") == symbols.end());
+
+    auto [it, inserted] = symbols.try_emplace<Variable>("x", 3);
+    assert(inserted && it->first == "x" && it->second->kind() == 1);
+    assert(!symbols.try_emplace<Function>("x").second);        // Already present, nothing is constructed.
+    assert(symbols.at("x")->kind() == 1);
+
+    symbols.try_emplace<Function>("f");
+    symbols.try_emplace("s");
+    assert(symbols.size() == 3);
+    assert(symbols.at("f")->kind() == 2 && symbols.at("s")->kind() == 0);
+
+    symbols.insert_or_assign<Variable>("f", 5);
+    assert(symbols.size() == 3 && symbols.at("f").value<Variable>().slot == 5);
+
+    // Grow through several rehashes, with a mix of inline and heap stored values.
+    for (int i = 0; i < 1000; i++) {
+        std::string key = "v" + std::to_string(i);
+        if (i % 3 == 0)
+            symbols.try_emplace<Function>(key);
+        else
+            symbols.try_emplace<Variable>(key, i);
+    }
+    assert(symbols.size() == 1003);
+    for (int i = 0; i < 1000; i++) {
+        auto& value = symbols.at("v" + std::to_string(i));
+        assert(value->kind() == (i % 3 == 0 ? 2 : 1));
+        assert(i % 3 == 0 || value.value<Variable>().slot == i);
+    }
+
+    // Erase half and reinsert, reusing deleted slots.
+    for (int i = 0; i < 1000; i += 2)
+        assert(symbols.erase("v" + std::to_string(i)) == 1);
+    assert(symbols.erase("v0") == 0);
+    assert(symbols.size() == 503 && !symbols.contains("v0") && symbols.contains("v1"));
+    for (int i = 0; i < 1000; i += 2)
+        symbols.try_emplace<Variable>("v" + std::to_string(i), -i);
+    assert(symbols.size() == 1003 && symbols.at("v10").value<Variable>().slot == -10);
+
+    size_t count = 0;
+    for (auto [key, value] : symbols) {
+        assert(value);
+        count++;
+    }
+    assert(count == symbols.size());
+
+    // Erase while iterating
+    for (auto i = symbols.begin(); i != symbols.end();) {
+        if (i->second->kind() == 2)
+            i = symbols.erase(i);
+        else
+            ++i;
+    }
+    for (const auto& [key, value] : symbols)
+        assert(value->kind() != 2);
+
+    // Copy and move
+    auto copy = symbols;
+    assert(copy.size() == symbols.size() && copy.at("v1").value<Variable>().slot == 1);
+    auto moved = std::move(copy);
+    assert(copy.empty() && moved.size() == symbols.size());
+
+    // Each value is destroyed exactly once, also after rehashing.
+    {
+        polymorphic_flat_map<int, Symbol> counted;
+        for (int i = 0; i < 100; i++)
+            counted.try_emplace<CountedSymbol>(i);
+        assert(CountedSymbol::live == 100);
+        counted.erase(5);
+        assert(CountedSymbol::live == 99);
+        counted.reserve(1000);
+        assert(CountedSymbol::live == 99 && counted.size() == 99);
+        auto counted2 = counted;
+        assert(CountedSymbol::live == 198);
+        counted.clear();
+        assert(CountedSymbol::live == 99 && counted.empty());
+
+        // A throwing constructor leaves no key behind. A throwing copy destroys the entries copied before it and frees its table,
+        // and the source keeps all its entries.
+        ThrowingSymbol::fail = true;
+        assert(throws([&] { counted2.try_emplace<ThrowingSymbol>(1000); }) && !counted2.contains(1000));
+        ThrowingSymbol::fail = false;
+        counted2.try_emplace<ThrowingSymbol>(1000);
+        assert(throws([&] { auto counted3 = counted2; }) && CountedSymbol::live == 99);
+        assert(counted2.size() == 100 && counted2.contains(1000) && counted2.at(99)->kind() == 0);
+    }
+    assert(CountedSymbol::live == 0);
+
+    std::cout << "polymorphic_flat_map ok" << std::endl;
+}
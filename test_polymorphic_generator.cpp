@@ -0,0 +1,108 @@
+#include "polymorphic_generator.h"
+#include "polymorphic_value_statistics.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+struct Token {
+    virtual ~Token() {}
+    virtual int kind() const { return 0; }
+};
+
+struct Number : public Token {
+    Number(int v) : value(v) {}
+    int kind() const override { return 1; }
+    int value;
+};
+
+struct Name : public Token {
+    Name(std::string_view s) : name(s) {}
+    int kind() const override { return 2; }
+    std::string name;
+};
+
+struct Huge : public Token {
+    int kind() const override { return 3; }
+    char text[200] = {};
+};
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+using TokenStream = polymorphic_generator<Token, polymorphic_value_options{ .statistics = true }>;
+
+// Splits text into space separated numbers and names.
+static TokenStream tokenize(std::string_view text)
+{
+    while (!text.empty()) {
+        size_t end = text.find(' ');
+        std::string_view word = text.substr(0, end);
+        if (word == "!")
+            throw std::runtime_error("bad token");
+        if (word[0] >= '0' && word[0] <= '9')
+            co_yield yield_emplace<Number>(std::stoi(std::string(word)));
+        else
+            co_yield yield_emplace<Name>(word);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+    }
+}
+
+static TokenStream copies()
+{
+    Number n(5);
+    co_yield n;
+    co_yield Huge();
+}
+
+int main()
+{
+    int numbers = 0;
+    std::string names;
+    for (Token& t : tokenize("a 1 bc 22 d 333")) {
+        if (t.kind() == 1)
+            numbers += static_cast<Number&>(t).value;
+        else
+            names += static_cast<Name&>(t).name;
+    }
+    assert(numbers == 356 && names == "abcd");
+
+    polymorphic_value_statistics stats = TokenStream::value_type::statistics();
+    assert(stats.emplaces == 6 && stats.moves == 0 && stats.copies == 0 && stats.allocations == 0);
+
+    // The slot can be used for transform.
+    TokenStream stream = tokenize("7 x");
+    auto it = stream.begin();
+    assert(stream.current().transform<Number>([](Number& n) { return n.value; }) == 7);
+    ++it;
+    assert(it->kind() == 2 && !stream.current().transform<Number>([](Number& n) { return n.value; }));
+    ++it;
+    assert(it == stream.end());
+
+    // Objects are copied or moved into the slot, large ones are allocated.
+    int kinds = 0;
+    for (Token& t : copies())
+        kinds = kinds * 10 + t.kind();
+    assert(kinds == 13);
+    stats = TokenStream::value_type::statistics();
+    assert(stats.allocations == 1);
+
+    // An exception in the coroutine propagates to the consumer.
+    TokenStream bad = tokenize("1 ! 2");
+    auto bad_it = bad.begin();
+    bool thrown = false;
+    try {
+        ++bad_it;
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && bad_it == bad.end());
+
+    std::cout << "polymorphic_generator ok" << std::endl;
+}
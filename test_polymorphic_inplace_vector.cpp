@@ -0,0 +1,124 @@
+#include "polymorphic_inplace_vector.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+struct Command {
+    virtual ~Command() {}
+    virtual int kind() const { return 0; }
+};
+
+struct Move : public Command {
+    Move(int dx, int dy) : dx(dx), dy(dy) {}
+    int kind() const override { return 1; }
+    int dx, dy;
+};
+
+struct Say : public Command {
+    Say(std::string text) : text(std::move(text)) {}
+    int kind() const override { return 2; }
+    std::string text;
+};
+
+struct alignas(32) Wide : public Command {
+    int kind() const override { return 3; }
+    double values[4] = {};
+};
+
+using CountedCommand = Counted<Command>;
+using ThrowingCommand = Throwing<Command>;
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+using Commands = polymorphic_inplace_vector<Command, 512, polymorphic_value_options{ .alignment = 32 }>;
+
+
+int main()
+{
+    Commands commands;
+    assert(commands.empty() && commands.begin() == commands.end());
+
+    Move* m = commands.try_emplace_back<Move>(1, 2);
+    assert(m != nullptr && m->dx == 1);
+    commands.emplace_back<Say>("hi");
+    commands.emplace_back<Wide>();
+    commands.push_back(Move(3, 4));
+    assert(commands.size() == 4 && commands.front().kind() == 1 && commands.back().kind() == 1);
+
+    int kinds[] = { 1, 2, 3, 1 };
+    int i = 0;
+    for (const Command& c : commands) {
+        assert(c.kind() == kinds[i++]);
+        if (c.kind() == 3)
+            assert(reinterpret_cast<uintptr_t>(&c) % 32 == 0);
+    }
+    assert(i == 4);
+
+    // Objects are packed at their own size, so small commands use much less than a polymorphic_value each.
+    assert(commands.bytes_used() < 4 * sizeof(polymorphic_value<Command>));
+
+    commands.pop_back();
+    assert(commands.size() == 3 && commands.back().kind() == 3);
+    commands.pop_back();
+    assert(static_cast<Say&>(commands.back()).text == "hi");
+
+    // Overflow
+    size_t count = commands.size();
+    while (commands.try_emplace_back<Move>(0, 0) != nullptr)
+        count++;
+    assert(commands.size() == count && commands.bytes_used() <= commands.capacity());
+    try {
+        commands.emplace_back<Move>(0, 0);
+        assert(false);
+    }
+    catch (std::bad_alloc&) {
+    }
+    commands.pop_back();
+    assert(commands.try_emplace_back<Move>(5, 6) != nullptr);
+
+    // Copy and move
+    Commands copy = commands;
+    assert(copy.size() == commands.size() && static_cast<Move&>(copy.back()).dx == 5);
+    Commands moved = std::move(copy);
+    assert(copy.empty() && moved.size() == commands.size());
+    assert(static_cast<Say&>(*++moved.begin()).text == "hi");
+
+    // Each object is destroyed exactly once.
+    {
+        polymorphic_inplace_vector<Command, 256> counted;
+        while (counted.try_emplace_back<CountedCommand>() != nullptr)
+            ;
+        int n = CountedCommand::live;
+        assert(n == int(counted.size()));
+        auto counted2 = counted;
+        auto counted3 = std::move(counted);
+        assert(CountedCommand::live == 2 * n && counted.empty());
+        counted3.pop_back();
+        assert(CountedCommand::live == 2 * n - 1);
+    }
+    assert(CountedCommand::live == 0);
+
+    // A throwing constructor leaves the buffer as it was, so the next element goes where the failed one would have been. A
+    // throwing copy destroys the elements copied before it.
+    {
+        polymorphic_inplace_vector<Command, 256> partly;
+        partly.emplace_back<CountedCommand>();
+        size_t used = partly.bytes_used();
+        ThrowingCommand::fail = true;
+        assert(throws([&] { partly.emplace_back<ThrowingCommand>(); }) && partly.size() == 1 && partly.bytes_used() == used);
+        ThrowingCommand::fail = false;
+        partly.emplace_back<CountedCommand>();
+        assert(partly.bytes_used() == 2 * used);
+        partly.emplace_back<ThrowingCommand>();
+        assert(throws([&] { auto copy = partly; }) && CountedCommand::live == 2 && partly.size() == 3);
+    }
+    assert(CountedCommand::live == 0);
+
+    std::cout << "polymorphic_inplace_vector ok" << std::endl;
+}
@@ -0,0 +1,128 @@
+#include "polymorphic_record_reader.h"
+#include "polymorphic_value_statistics.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+struct Event {
+    virtual ~Event() {}
+    virtual int value() const { return 0; }
+};
+
+struct Click : public Event {
+    Click(std::span<const std::byte> bytes) { std::memcpy(&x, bytes.data(), sizeof(x)); }
+    int value() const override { return x; }
+    int x;
+};
+
+struct Note : public Event {
+    Note(std::span<const std::byte> bytes) : text(reinterpret_cast<const char*>(bytes.data()), bytes.size()) {}
+    int value() const override { return int(text.size()); }
+    std::string text;
+};
+
+using Registry = polymorphic_type_registry<Event, polymorphic_value_options{ .statistics = true }>;
+using Reader = polymorphic_record_reader<Event, polymorphic_value_options{ .statistics = true }>;
+
+static void append_click(std::vector<std::byte>& out, int x)
+{
+    Reader::append(out, 1, std::as_bytes(std::span(&x, 1)));
+}
+
+static void append_note(std::vector<std::byte>& out, const std::string& text)
+{
+    Reader::append(out, 2, std::as_bytes(std::span(text.data(), text.size())));
+}
+
+static std::string to_string(const std::vector<std::byte>& bytes)
+{
+    return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+int main()
+{
+    Registry registry;
+    registry.add<Click>(1);
+    registry.add<Note>(2);
+
+    std::vector<std::byte> records;
+    int expected = 0;
+    for (int i = 0; i < 100; i++) {
+        append_click(records, i);
+        expected += i;
+        if (i % 10 == 0) {
+            append_note(records, std::string(i, 'n'));
+            expected += i;
+        }
+    }
+    append_note(records, "");
+
+    // One reused slot.
+    {
+        Reader reader(registry, records);
+        Reader::value_type slot;
+        int sum = 0;
+        int count = 0;
+        while (reader.read(slot)) {
+            sum += slot->value();
+            count++;
+        }
+        assert(count == 111 && sum == expected && reader.bytes_read() == records.size());
+        assert(!reader.read(slot) && slot->value() == 0);
+    }
+    assert(Reader::value_type::statistics().allocations == 0);
+
+    // Batches, from a stream through a buffer smaller than the largest record.
+    {
+        std::istringstream stream(to_string(records));
+        Reader reader(registry, stream, 16);
+        Reader::value_type batch[8];
+        int sum = 0;
+        int count = 0;
+        while (size_t n = reader.read(std::span(batch))) {
+            for (size_t i = 0; i < n; i++)
+                sum += batch[i]->value();
+            count += int(n);
+        }
+        assert(count == 111 && sum == expected && reader.bytes_read() == records.size());
+    }
+
+    // Errors.
+    std::vector<std::byte> unknown;
+    Reader::append(unknown, 7, {});
+    Reader::value_type slot;
+    bool thrown = false;
+    try {
+        Reader(registry, unknown).read(slot);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::vector<std::byte> truncated(records.begin(), records.begin() + 14);
+    std::istringstream truncated_stream(to_string(truncated));
+    Reader truncated_reader(registry, truncated_stream);
+    assert(truncated_reader.read(slot));
+    thrown = false;
+    try {
+        truncated_reader.read(slot);
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::cout << "polymorphic_record_reader ok" << std::endl;
+}
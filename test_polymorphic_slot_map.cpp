@@ -0,0 +1,158 @@
+#include "polymorphic_slot_map.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+struct Entity {
+    virtual ~Entity() {}
+    virtual int kind() const { return 0; }
+};
+
+struct Mover : public Entity {
+    Mover(int speed) : speed(speed) {}
+    int kind() const override { return 1; }
+    int speed;
+};
+
+struct Spawner : public Entity {
+    int kind() const override { return 2; }
+    char state[200] = {};           // Too large for the SBO buffer.
+};
+
+using CountedEntity = Counted<Entity>;
+using ThrowingEntity = Throwing<Entity>;
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+using EntityMap = polymorphic_slot_map<Entity, polymorphic_value_options{}, 16>;
+
+static_assert(sizeof(EntityMap::handle) == 4);
+
+
+int main()
+{
+    EntityMap entities;
+    assert(entities.empty() && !entities.contains(EntityMap::handle()));
+
+    auto m = entities.emplace<Mover>(3);
+    auto s = entities.emplace<Spawner>();
+    auto e = entities.emplace();
+    assert(entities.size() == 3);
+    assert(entities.at(m)->kind() == 1 && entities[s]->kind() == 2 && entities.find(e)->get()->kind() == 0);
+
+    // Stale handles are detected, also when the slot is reused.
+    Entity* spawner = entities[s].get();
+    assert(entities.erase(m));
+    assert(!entities.erase(m) && !entities.contains(m) && entities.find(m) == nullptr);
+    assert(entities[s].get() == spawner);       // e was relocated into the hole left by m, s was not moved.
+    auto m2 = entities.emplace<Mover>(4);
+    assert(m2.index() == m.index() && m2 != m);
+    assert(!entities.contains(m) && entities.at(m2).value<Mover>().speed == 4);
+
+    // Free slots are reused in the order they were freed. A slot is retired when its 8 bit generation is used up, so a handle never
+    // matches a value of a later generation of its slot.
+    {
+        EntityMap cycled;
+        std::vector<EntityMap::handle> first;
+        for (int i = 0; i < 4; i++)
+            first.push_back(cycled.emplace<Mover>(i));
+        for (int i = 0; i < 4; i++)
+            cycled.erase(first[i]);
+        EntityMap::handle h;
+        for (int i = 0; i < 4; i++) {
+            h = cycled.emplace<Mover>(i);
+            assert(h.index() == first[i].index() && h.generation() == first[i].generation() + 1);
+        }
+        std::vector<EntityMap::handle> reused;
+        for (int i = 0; i < 300; i++) {
+            reused.push_back(h);
+            cycled.erase(h);
+            h = cycled.emplace<Mover>(i);
+        }
+        assert(reused[254].index() == 3 && reused[254].generation() == 255);
+        assert(h.index() == 4 && h.generation() == 45);
+        for (EntityMap::handle old : reused)
+            assert(!cycled.contains(old));
+    }
+
+    // Grow over many chunks. Values of existing chunks are not moved.
+    Entity* first = entities.begin()->get();
+    std::vector<EntityMap::handle> handles;
+    for (int i = 0; i < 1000; i++)
+        handles.push_back(entities.emplace<Mover>(i));
+    assert(entities.size() == 1003 && entities.begin()->get() == first);
+    for (int i = 0; i < 1000; i++)
+        assert(entities.at(handles[i]).value<Mover>().speed == i);
+
+    // Erase every other and check that the others are still found.
+    for (int i = 0; i < 1000; i += 2)
+        assert(entities.erase(handles[i]));
+    for (int i = 0; i < 1000; i++)
+        assert(entities.contains(handles[i]) == (i % 2 == 1));
+    for (int i = 1; i < 1000; i += 2)
+        assert(entities.at(handles[i]).value<Mover>().speed == i);
+
+    // Dense iteration only visits live values and iterators know their handle.
+    size_t count = 0;
+    for (auto i = entities.begin(); i != entities.end(); ++i) {
+        assert(*i && &entities[i.get_handle()] == &*i);
+        count++;
+    }
+    assert(count == entities.size() && entities.size() == 503);
+
+    for (auto i = entities.begin(); i != entities.end();) {
+        if ((*i)->kind() == 1)
+            i = entities.erase(i);
+        else
+            ++i;
+    }
+    assert(entities.size() == 2 && entities.contains(s) && entities.contains(e));
+
+    // Copy and move keep handles valid.
+    auto copy = entities;
+    assert(copy.at(s)->kind() == 2 && copy.at(e)->kind() == 0);
+    auto moved = std::move(copy);
+    assert(copy.empty() && moved.at(s)->kind() == 2);
+
+    // Each value is destroyed exactly once.
+    {
+        EntityMap counted;
+        std::vector<EntityMap::handle> ch;
+        for (int i = 0; i < 100; i++)
+            ch.push_back(counted.emplace<CountedEntity>());
+        assert(CountedEntity::live == 100);
+        counted.erase(ch[3]);
+        counted.erase(ch[99]);
+        assert(CountedEntity::live == 98);
+        auto counted2 = counted;
+        assert(CountedEntity::live == 196);
+        counted.clear();
+        assert(CountedEntity::live == 98 && !counted.contains(ch[0]));
+    }
+    assert(CountedEntity::live == 0);
+
+    // A throwing constructor neither takes the free slot nor uses up a generation of it, and a throwing copy destroys the values
+    // copied so far.
+    {
+        EntityMap map;
+        auto c = map.emplace<CountedEntity>();
+        auto freed = map.emplace<Mover>(1);
+        map.emplace<ThrowingEntity>();
+        map.erase(freed);
+        ThrowingEntity::fail = true;
+        assert(throws([&] { map.emplace<ThrowingEntity>(); }) && map.size() == 2);
+        ThrowingEntity::fail = false;
+        assert(throws([&] { EntityMap copy = map; }) && CountedEntity::live == 1);
+        auto t = map.emplace<ThrowingEntity>();
+        assert(t.index() == freed.index() && t.generation() == freed.generation() + 1 && map.contains(c));
+    }
+    assert(CountedEntity::live == 0);
+
+    std::cout << "polymorphic_slot_map ok" << std::endl;
+}
@@ -0,0 +1,153 @@
+#include "polymorphic_stack.h"
+#include "test_fixtures.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+struct Frame {
+    virtual ~Frame() {}
+    virtual int kind() const { return 0; }
+};
+
+struct CallFrame : public Frame {
+    CallFrame(int depth) : depth(depth) {}
+    int kind() const override { return 1; }
+    int depth;
+};
+
+struct LocalsFrame : public Frame {
+    LocalsFrame(std::string name) : name(std::move(name)) {}
+    int kind() const override { return 2; }
+    std::string name;
+    double locals[8] = {};
+};
+
+struct HugeFrame : public Frame {
+    int kind() const override { return 3; }
+    char data[5000] = {};           // Larger than a chunk.
+};
+
+using CountedFrame = Counted<Frame>;
+using ThrowingFrame = Throwing<Frame>;
+
+#if IS_STANDARDIZED
+using namespace std;
+#else
+using namespace stdx;
+#endif
+
+using FrameStack = polymorphic_stack<Frame, polymorphic_value_options{}, 1024>;
+
+
+int main()
+{
+    FrameStack frames;
+    assert(frames.empty() && frames.begin() == frames.end());
+
+    CallFrame& bottom = frames.emplace<CallFrame>(0);
+    frames.emplace<LocalsFrame>("f");
+    frames.push(CallFrame(1));
+    assert(frames.size() == 3 && frames.top().kind() == 1 && static_cast<CallFrame&>(frames.top()).depth == 1);
+
+    // Iteration is from the top down.
+    int kinds[] = { 1, 2, 1 };
+    int i = 0;
+    for (const Frame& f : frames)
+        assert(f.kind() == kinds[i++]);
+    assert(i == 3);
+
+    frames.pop();
+    assert(static_cast<LocalsFrame&>(frames.top()).name == "f");
+
+    // Deep recursion over many chunks, and back. Objects are never moved.
+    for (int depth = 1; depth <= 1000; depth++) {
+        if (depth % 2 == 0)
+            frames.emplace<LocalsFrame>(std::to_string(depth));
+        else
+            frames.emplace<CallFrame>(depth);
+    }
+    frames.emplace<HugeFrame>();
+    assert(frames.size() == 1003 && frames.top().kind() == 3);
+    frames.pop();
+    for (int depth = 1000; depth >= 1; depth--) {
+        if (depth % 2 == 0)
+            assert(static_cast<LocalsFrame&>(frames.top()).name == std::to_string(depth));
+        else
+            assert(static_cast<CallFrame&>(frames.top()).depth == depth);
+        frames.pop();
+    }
+    assert(frames.size() == 2 && frames.top().kind() == 2);
+
+    // Oscillating around a chunk boundary reuses the chunks.
+    for (int n = 0; n < 100; n++) {
+        for (int k = 0; k < 50; k++)
+            frames.emplace<CallFrame>(k);
+        for (int k = 0; k < 50; k++)
+            frames.pop();
+    }
+    assert(frames.size() == 2);
+
+    // Copy and move
+    auto copy = frames;
+    assert(copy.size() == 2 && static_cast<LocalsFrame&>(copy.top()).name == "f");
+    auto moved = std::move(copy);
+    assert(copy.empty() && moved.size() == 2);
+    frames.pop();
+    assert(&frames.top() == &bottom);
+    frames.pop();
+    assert(frames.empty());
+
+    // A huge frame first in an empty stack, then popped.
+    frames.emplace<HugeFrame>();
+    frames.pop();
+    frames.emplace<CallFrame>(7);
+    assert(frames.size() == 1 && static_cast<CallFrame&>(frames.top()).depth == 7);
+    frames.shrink_to_fit();
+
+    // Each object is destroyed exactly once.
+    {
+        FrameStack counted;
+        for (int n = 0; n < 200; n++)
+            counted.emplace<CountedFrame>();
+        counted.pop();
+        assert(CountedFrame::live == 199);
+        auto counted2 = counted;
+        assert(CountedFrame::live == 398);
+        counted2 = std::move(counted);
+        assert(CountedFrame::live == 199 && counted.empty());
+        counted = counted2;
+        assert(CountedFrame::live == 398);
+        counted.clear();
+        assert(CountedFrame::live == 199 && counted.empty());
+
+        // A throwing copy destroys the frames copied below it, and the source can still be popped down to the bottom.
+        counted2.emplace<ThrowingFrame>();
+        assert(throws([&] { auto counted3 = counted2; }) && CountedFrame::live == 199);
+        counted2.pop();
+        while (!counted2.empty())
+            counted2.pop();
+        assert(CountedFrame::live == 0);
+    }
+
+    // A constructor which throws when its frame is the first in a new chunk leaves the stack in the previous chunk, so popping and
+    // pushing again stays within the chunks.
+    {
+        FrameStack boundary;
+        while (boundary.size() < 1000) {
+            boundary.emplace<CallFrame>(int(boundary.size()));
+            boundary.emplace<CallFrame>(int(boundary.size()));
+            ThrowingFrame::fail = true;
+            bool thrown = throws([&] { boundary.emplace<ThrowingFrame>(); });
+            ThrowingFrame::fail = false;
+            assert(thrown);
+            boundary.pop();
+        }
+        for (int depth = 999; depth >= 0; depth--) {
+            assert(static_cast<CallFrame&>(boundary.top()).depth == depth);
+            boundary.pop();
+        }
+    }
+
+    std::cout << "polymorphic_stack ok" << std::endl;
+}
@@ -1,8 +1,19 @@
 #include "polymorphic_value.h"
+#include "polymorphic_value_batch_destroy.h"
+#include "polymorphic_value_compare.h"
+#include "polymorphic_value_huge_page_heap.h"
+#include "polymorphic_value_reclaimer.h"
+#include "polymorphic_value_statistics.h"
 
+#include <atomic>
 #include <cassert>
 #include <iostream>
 #include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 struct SmallBase {
     virtual ~SmallBase() {}
@@ -22,6 +33,12 @@ struct BigSub : public SmallBase {
     int y[100];
 };
 
+// Throws from its constructor, inline or heap allocated depending on Size.
+template<size_t Size> struct ThrowingSub : public SmallBase {
+    ThrowingSub() { throw std::runtime_error("ThrowingSub"); }
+    char data[Size] = {};
+};
+
 #if IS_STANDARDIZED
 using namespace std;
 #else
@@ -41,6 +58,70 @@ struct MoveOnly : public SmallBase {
     MoveOnly& operator=(MoveOnly&) = default;
 };
 
+// Trivially copyable classes which can share handlers.
+struct TrivialBase {
+    int kind = 0;
+};
+
+struct TrivialSub : public TrivialBase {
+    TrivialSub(int v) : value(v) { kind = 1; }
+    int value;
+};
+
+struct TrivialOtherSub : public TrivialBase {
+    TrivialOtherSub(float v) : value(v) { kind = 2; }
+    float value;
+};
+
+struct TrivialBigSub : public TrivialBase {
+    int values[100] = {};
+};
+
+// Allocated by its own overloaded operator new and delete, so batched destruction must free it through them.
+struct TrivialPooledSub : public TrivialBase {
+    static void* operator new(size_t size) { return ::operator new(size); }
+    static void operator delete(void* p) { deletes++; ::operator delete(p); }
+    static void operator delete(void* p, std::align_val_t a) { deletes++; ::operator delete(p, a); }
+    static inline int deletes = 0;
+    int values[100] = {};
+};
+
+// Counts its destructor calls to check that batched destruction only skips trivially destructible objects.
+struct CountedBase {
+    virtual ~CountedBase() { destroyed++; }
+    static inline int destroyed = 0;
+};
+
+// Records the thread it was destroyed on to check deferred destruction.
+struct Heavy : public CountedBase {
+    ~Heavy() { destroyed_on = std::this_thread::get_id(); }
+    static inline std::atomic<std::thread::id> destroyed_on;
+    int cache[100] = {};
+};
+
+// Key classes with comparison and hashing.
+struct Key {
+    virtual ~Key() {}
+    bool operator==(const Key&) const = default;
+    auto operator<=>(const Key&) const = default;
+    int id = 0;
+};
+
+struct NamedKey : public Key {
+    NamedKey(int i, std::string n) : name(std::move(n)) { id = i; }
+    bool operator==(const NamedKey&) const = default;
+    auto operator<=>(const NamedKey&) const = default;
+    std::string name;
+};
+
+template<> struct std::hash<Key> {
+    size_t operator()(const Key& k) const { return std::hash<int>()(k.id); }
+};
+template<> struct std::hash<NamedKey> {
+    size_t operator()(const NamedKey& k) const { calls++; return std::hash<int>()(k.id) ^ std::hash<std::string>()(k.name); }
+    static inline int calls = 0;
+};
+
 
 int main()
 {
@@ -110,6 +191,23 @@ int main()
     sv2.reset();
     assert(!sv2);
 
+    // A throwing constructor in emplace leaves the value empty, the previous object has already been destroyed.
+    for (int i = 0; i < 2; i++) {
+        sv2.emplace<SmallSub>(5);
+        bool thrown = false;
+        try {
+            if (i == 0)
+                sv2.emplace<ThrowingSub<8>>();
+            else
+                sv2.emplace<ThrowingSub<400>>();
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && !sv2);
+        sv2.reset();
+    }
+
     auto bv = polymorphic_value<SmallBase>::make<BigSub>();
     bv->identify();
 
@@ -137,4 +235,216 @@ int main()
     polymorphic_value_for<SmallBase, SmallSub, BigSub, MoveOnly> sv4(std::in_place_type<BigSub>);
 
     // auto sv5 = sv4; No copy with MoveOnly in the list.
+
+    // Test statistics
+    using CountedPoly = polymorphic_value<SmallBase, polymorphic_value_options{ .statistics = true }>;
+    {
+        CountedPoly cv(std::in_place_type<SmallSub>, 1);
+        CountedPoly cv2 = cv;
+        cv2.emplace<BigSub>();
+        CountedPoly cv3 = std::move(cv2);
+        CountedPoly cv4 = cv3;
+    }
+    polymorphic_value_statistics stats = CountedPoly::statistics();
+    assert(stats.emplaces == 2);
+    assert(stats.copies == 2);
+    assert(stats.moves == 1);
+    assert(stats.allocations == 2 && stats.deallocations == 2);
+    assert(stats.allocated_bytes == 2 * sizeof(BigSub));
+    assert(stats.destroys == 4);     // Moving a BigSub only moves the pointer, no object is destroyed.
+
+    // Test shared handlers. TrivialSub and TrivialOtherSub have the same size and share a handler.
+    using SharedPoly = polymorphic_value<TrivialBase, polymorphic_value_options{ .size = 16, .share_handlers = true }>;
+    SharedPoly tv(std::in_place_type<TrivialSub>, 3);
+    SharedPoly tv2 = tv;
+    assert(tv2->kind == 1 && static_cast<TrivialSub&>(*tv2).value == 3);
+    tv2.emplace<TrivialOtherSub>(2.5f);
+    tv = std::move(tv2);
+    assert(!tv2);
+    assert(tv->kind == 2 && static_cast<TrivialOtherSub&>(*tv).value == 2.5f);
+
+    // Test dispatch-free access. Emplacing a U with T at a non-zero offset is a compile time error.
+    using DirectPoly = polymorphic_value<SmallBase, polymorphic_value_options{ .size = 16, .heap = false, .zero_offset = true }>;
+    DirectPoly dv;
+    assert(!dv && dv.get() == nullptr);
+    dv.emplace<SmallSub>(6);
+    assert(dv && static_cast<SmallSub*>(dv.get())->y == 6 && dv->x == 17);
+    DirectPoly dv2 = std::move(dv);
+    assert(!dv && dv2.value<SmallSub>().y == 6);
+    dv2.reset();
+    assert(!dv2);
+
+    // Test prefetching, which has no visible effect.
+    std::vector<polymorphic_value<SmallBase>> values;
+    for (int i = 0; i < 100; i++) {
+        if (i % 3 == 0)
+            values.emplace_back(std::in_place_type<BigSub>);
+        else if (i % 3 == 1)
+            values.emplace_back(std::in_place_type<SmallSub>, i);
+        else
+            values.emplace_back();
+    }
+    values[0].prefetch();
+    values[1].prefetch();
+    values[2].prefetch();
+    int visited = 0;
+    for_each_prefetched(values, 8, [&](polymorphic_value<SmallBase>& v) {
+        assert(bool(v) == (visited % 3 != 2));
+        visited++;
+    });
+    assert(visited == 100);
+    for_each_prefetched(values, 1000, [&](const polymorphic_value<SmallBase>&) { visited++; });
+    assert(visited == 200);
+
+    // Test batched destruction. Trivially destructible objects are skipped and their heap blocks are freed together.
+    using BatchPoly = polymorphic_value<TrivialBase, polymorphic_value_options{ .size = 16, .statistics = true }>;
+    {
+        std::vector<BatchPoly> batch;
+        batch.reserve(100);         // Relocations when growing would also count destroys.
+        for (int i = 0; i < 100; i++) {
+            if (i % 3 == 0)
+                batch.emplace_back(std::in_place_type<TrivialBigSub>);
+            else if (i % 3 == 1)
+                batch.emplace_back(std::in_place_type<TrivialSub>, i);
+            else
+                batch.emplace_back();
+        }
+        clear(batch);
+        assert(batch.empty());
+
+        for (int i = 0; i < 10; i++)
+            batch.emplace_back(std::in_place_type<TrivialBigSub>);
+        destroy_range(batch.begin(), batch.begin() + 5, polymorphic_value_reclaimer::instance());
+        for (int i = 0; i < 5; i++)
+            std::construct_at(&batch[i]);       // The values must be constructed again before the vector destroys them.
+        assert(!batch[0] && batch[5]);
+    }
+    polymorphic_value_statistics batch_stats = BatchPoly::statistics();
+    assert(batch_stats.allocations == 44 && batch_stats.deallocations == 44);
+    assert(batch_stats.destroys == 77);
+
+    {
+        std::vector<BatchPoly> pooled;
+        pooled.reserve(10);
+        for (int i = 0; i < 10; i++)
+            pooled.emplace_back(std::in_place_type<TrivialPooledSub>);
+        clear(pooled);
+        pooled.emplace_back(std::in_place_type<TrivialPooledSub>);
+        destroy_range(pooled.begin(), pooled.end());
+        std::construct_at(&pooled[0]);
+    }
+    assert(TrivialPooledSub::deletes == 11);
+
+    std::vector<polymorphic_value<CountedBase>> counted(10);
+    for (auto& c : counted)
+        c.emplace<CountedBase>();
+    clear(counted, polymorphic_value_reclaimer::instance());
+    assert(CountedBase::destroyed == 10);
+
+    // Test deferred destruction. Heap allocated objects are destroyed on the reclaimer thread, SBO objects directly.
+    using DeferredPoly = polymorphic_value<CountedBase, polymorphic_value_options{ .deferred_destroy = true }>;
+    CountedBase::destroyed = 0;
+    DeferredPoly deferred(std::in_place_type<Heavy>);
+    deferred.reset();
+    polymorphic_value_reclaimer::instance().flush();
+    assert(CountedBase::destroyed == 1 && Heavy::destroyed_on.load() != std::this_thread::get_id());
+
+    deferred.emplace<CountedBase>();
+    deferred.reset();
+    assert(CountedBase::destroyed == 2);
+
+    // More objects than fit the ring, the overflow is destroyed on this thread.
+    {
+        std::vector<DeferredPoly> heavies(polymorphic_value_reclaimer::capacity * 2);
+        for (auto& h : heavies)
+            h.emplace<Heavy>();
+    }
+    polymorphic_value_reclaimer::instance().flush();
+    assert(CountedBase::destroyed == 2 + 2 * int(polymorphic_value_reclaimer::capacity));
+
+    polymorphic_value<CountedBase> plain(std::in_place_type<Heavy>);
+    deferred_destroy(std::move(plain));
+    assert(!plain);
+    polymorphic_value_reclaimer::instance().flush();
+    assert(CountedBase::destroyed == 3 + 2 * int(polymorphic_value_reclaimer::capacity));
+
+    // Test the generation counter and memo. Const access does not change the generation.
+    using ModelPoly = polymorphic_value<SmallBase, polymorphic_value_options{ .generation = true }>;
+    ModelPoly model(std::in_place_type<SmallSub>, 2);
+    const ModelPoly& const_model = model;
+    int computations = 0;
+    polymorphic_value_memo doubled(model, [&](const SmallBase& b) {
+        computations++;
+        return static_cast<const SmallSub&>(b).y * 2;
+    });
+    uint64_t generation = model.generation();
+    assert(doubled() == 4 && doubled() == 4 && computations == 1);
+    assert(const_model->x == 17 && model.generation() == generation);
+    static_cast<SmallSub&>(*model).y = 5;
+    assert(model.generation() > generation);
+    assert(doubled() == 10 && doubled() == 10 && computations == 2);
+    model.emplace<SmallSub>(6);
+    assert(doubled() == 12 && computations == 3);
+    model = ModelPoly(std::in_place_type<SmallSub>, 7);
+    assert(doubled() == 14 && computations == 4);
+    model.reset();
+    assert(doubled() == 0 && computations == 4);
+    doubled.invalidate();
+    assert(doubled() == 0);
+
+    // Test the huge page heap. A freed slot is reused by the next object of the same size class.
+    using HugePoly = polymorphic_value<CountedBase, polymorphic_value_options{ .size = 16, .huge_pages = true }>;
+    CountedBase::destroyed = 0;
+    HugePoly huge(std::in_place_type<Heavy>);
+    static_cast<Heavy&>(*huge).cache[99] = 3;
+    HugePoly huge_copy = huge;
+    assert(&*huge_copy != &*huge && static_cast<Heavy&>(*huge_copy).cache[99] == 3);
+    CountedBase* slot = &*huge_copy;
+    huge_copy.reset();
+    huge_copy.emplace<Heavy>();
+    assert(&*huge_copy == slot && CountedBase::destroyed == 1);
+    HugePoly huge_moved = std::move(huge);
+    assert(static_cast<Heavy&>(*huge_moved).cache[99] == 3);
+#if defined(__linux__)
+    assert(polymorphic_value_huge_page_heap::instance().bytes_reserved() >= polymorphic_value_huge_page_heap::region_size);
+    assert(reinterpret_cast<uintptr_t>(slot) / polymorphic_value_huge_page_heap::region_size ==
+           reinterpret_cast<uintptr_t>(&*huge_moved) / polymorphic_value_huge_page_heap::region_size);
+#endif
+    huge_moved.reset();
+    huge_copy.reset();
+    assert(CountedBase::destroyed == 3);
+
+    // Test comparison and hashing
+    using KeyPoly = polymorphic_value<Key, polymorphic_value_options{ .compare = true, .hash = true }>;
+    KeyPoly k1(std::in_place_type<NamedKey>, 1, "one");
+    KeyPoly k2(std::in_place_type<NamedKey>, 1, "one");
+    KeyPoly k3(std::in_place_type<Key>);
+    KeyPoly k4;
+    assert(k1 == k2 && k1.hash() == k2.hash());
+    assert(k1 != k3);                   // Different Us are not equal even if the Key parts are.
+    k3->id = 1;
+    assert(k1 != k3);
+    assert(k4 == KeyPoly() && k4 < k1 && k4 < k3);
+    k2.emplace<NamedKey>(1, "two");
+    assert(k1 < k2 && k2 > k1);
+    assert(is_lt(k1 <=> k3) || is_gt(k1 <=> k3));
+
+    std::unordered_set<KeyPoly> keys;
+    keys.insert(k1);
+    keys.insert(k2);
+    keys.insert(k3);
+    keys.insert(k4);
+    assert(keys.size() == 4);
+    assert(keys.contains(KeyPoly::make<NamedKey>(1, "one")));
+    assert(!keys.contains(KeyPoly::make<NamedKey>(2, "one")));
+
+    using CachedKeyPoly = polymorphic_value<Key, polymorphic_value_options{ .compare = true, .cache_hash = true }>;
+    CachedKeyPoly ck(std::in_place_type<NamedKey>, 1, "one");
+    size_t h = ck.hash();
+    assert(h == ck.hash() && h == CachedKeyPoly(ck).hash());
+    int calls = std::hash<NamedKey>::calls;
+    const CachedKeyPoly& const_ck = ck;
+    assert(const_ck->id == 1 && ck.hash() == h && std::hash<NamedKey>::calls == calls);     // Const access keeps it.
+    static_cast<NamedKey&>(*ck).name = "two";       // Non-const access invalidates the cached hash.
+    assert(ck.hash() == std::hash<CachedKeyPoly>()(CachedKeyPoly::make<NamedKey>(1, "two")));
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include <cassert>
+#include <new>              // GCC 12 fails in <tuple> or in the lookup of placement new unless <new>, <tuple>, <type_traits> and
+#include <tuple>            // <utility> are included before the import.
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+import stdx.polymorphic_value;
+
+struct ModuleBase {
+    virtual ~ModuleBase() {}
+    virtual int identify() const { return 0; }
+};
+
+struct ModuleSub : public ModuleBase {
+    ModuleSub(int y) : y(y) {}
+    int identify() const override { return y; }
+    int y;
+};
+
+struct ModuleBigSub : public ModuleBase {
+    int identify() const override { return 100; }
+    int y[100];
+};
+
+
+int main()
+{
+    stdx::polymorphic_value<ModuleBase> mv(std::in_place_type<ModuleSub>, 3);
+    assert(mv->identify() == 3);
+
+    auto mv2 = mv;
+    mv2.emplace<ModuleBigSub>();
+    mv = std::move(mv2);
+    assert(!mv2);
+    assert(mv->identify() == 100);
+
+    stdx::polymorphic_value_for<ModuleBase, ModuleSub, ModuleBigSub> mv3(std::in_place_type<ModuleBigSub>);
+    assert(mv3->identify() == 100);
+
+    // The importer's own <vector> must work next to the module, see polymorphic_value.cppm.
+    std::vector<stdx::polymorphic_value<ModuleBase>> values;
+    for (int i = 0; i < 10; ++i)
+        values.emplace_back(std::in_place_type<ModuleSub>, i);
+    values.emplace_back(std::in_place_type<ModuleBigSub>);
+    values.erase(values.begin());
+    assert(values.size() == 10);
+    assert(values.front()->identify() == 1 && values.back()->identify() == 100);
+}